@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Times bin/compiler on generated programs that grow along one axis at a
+// time, doubling the size at each step. Each row gives the time per doubling
+// as well: about 2x means the compiler scales linearly on that axis, about 4x
+// that something is quadratic.
+//
+// usage: bin/compiler_bench [-runs n] [-scale k] [scenario...]
+
+extern char **environ;
+
+static char *work_dir;
+static int lines;
+static int failed = 0;
+
+static FILE *create(const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    return f;
+}
+
+// Counts the lines written, for the throughput figures.
+static void line(FILE *f, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void line(FILE *f, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(f, fmt, args);
+    va_end(args);
+    fputc('\n', f);
+    lines++;
+}
+
+// n functions, each calling the one before it
+static void gen_functions(const char *dir, int n) {
+    FILE *f = create(dir, "main.vs");
+    line(f, "fn f0(x: int) -> int { return x; }");
+    for (int i = 1; i < n; i++) {
+        line(f, "fn f%d(x: int) -> int { return f%d(x) + %d; }", i, i - 1, i);
+    }
+    line(f, "fn main() -> int {");
+    line(f, "    assert(f%d(0) > 0);", n - 1);
+    line(f, "    return 0;");
+    line(f, "}");
+    fclose(f);
+}
+
+// n globals in an imported package, and n functions reading them (this was
+// bench/globals.sh)
+static void gen_globals(const char *dir, int n) {
+    char pkg[4096];
+    snprintf(pkg, sizeof(pkg), "%s/g", dir);
+    mkdir(pkg, 0755);
+    FILE *f = create(pkg, "g.vs");
+    for (int i = 0; i < n; i++) {
+        line(f, "v%d: int = %d;", i, i);
+    }
+    for (int i = 0; i < n; i++) {
+        line(f, "fn f%d() -> int { return v%d + v%d; }", i, i, (i * 7) % n);
+    }
+    fclose(f);
+
+    f = create(dir, "main.vs");
+    line(f, "#import \"%s\"", pkg);
+    line(f, "fn main() -> int {");
+    line(f, "    x := 0;");
+    for (int i = 0; i < n; i += 10) {
+        line(f, "    x += g.f%d() + g.v%d;", i, i);
+    }
+    line(f, "    return 0;");
+    line(f, "}");
+    fclose(f);
+}
+
+// blocks nested n deep, each declaring a variable and reading all of the
+// enclosing ones' most recent
+static void gen_nested(const char *dir, int n) {
+    FILE *f = create(dir, "main.vs");
+    line(f, "fn main() -> int {");
+    line(f, "    x0 := 0;");
+    for (int i = 1; i <= n; i++) {
+        line(f, "%*s{", i * 2, "");
+        line(f, "%*sx%d := x%d + x%d;", i * 2 + 2, "", i, i - 1, i / 2);
+    }
+    for (int i = n; i >= 1; i--) {
+        line(f, "%*s}", i * 2, "");
+    }
+    line(f, "    return x0;");
+    line(f, "}");
+    fclose(f);
+}
+
+// n struct types, each embedding the one before it
+static void gen_structs(const char *dir, int n) {
+    FILE *f = create(dir, "main.vs");
+    line(f, "type S0: struct { a: int; };");
+    for (int i = 1; i < n; i++) {
+        line(f, "type S%d: struct { a: int; b: &S%d; };", i, i - 1);
+    }
+    for (int i = 0; i < n; i++) {
+        line(f, "fn mk%d() -> S%d { return S%d::{a = %d}; }", i, i, i, i);
+    }
+    line(f, "fn main() -> int {");
+    line(f, "    x := mk%d();", n - 1);
+    line(f, "    return x.a - %d;", n - 1);
+    line(f, "}");
+    fclose(f);
+}
+
+// one polymorphic function instantiated for n distinct types
+static void gen_generics(const char *dir, int n) {
+    FILE *f = create(dir, "main.vs");
+    line(f, "fn first(x: $T, rest: T...) -> T { return x; }");
+    for (int i = 0; i < n; i++) {
+        line(f, "type T%d: struct { a: int; };", i);
+    }
+    line(f, "fn main() -> int {");
+    line(f, "    x := 0;");
+    for (int i = 0; i < n; i++) {
+        line(f, "    x += first(T%d::{%d}, T%d::{0}).a;", i, i, i);
+    }
+    line(f, "    return 0;");
+    line(f, "}");
+    fclose(f);
+}
+
+// n string literals of 1KB each
+static void gen_strings(const char *dir, int n) {
+    char s[1025];
+    FILE *f = create(dir, "main.vs");
+    line(f, "fn main() -> int {");
+    line(f, "    total := 0;");
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < 1024; j++) {
+            s[j] = 'a' + (i + j) % 26;
+        }
+        s[1024] = '\0';
+        line(f, "    s%d := \"%s\";", i, s);
+        line(f, "    total += s%d.length;", i);
+    }
+    line(f, "    assert(total == %d);", n * 1024);
+    line(f, "    return 0;");
+    line(f, "}");
+    fclose(f);
+}
+
+typedef struct Scenario {
+    char *name;
+    int base; // the first size
+    void (*gen)(const char *dir, int n);
+} Scenario;
+
+static Scenario scenarios[] = {
+    {"functions", 1000, gen_functions},
+    {"globals",   1000, gen_globals},
+    {"nested",    100,  gen_nested},
+    {"structs",   500,  gen_structs},
+    {"generics",  250,  gen_generics},
+    {"strings",   500,  gen_strings},
+};
+
+#define NUM_SCENARIOS (sizeof(scenarios) / sizeof(Scenario))
+#define STEPS 4
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs the compiler on dir/main.vs, returning its wall time and peak RSS (in
+// KB), or -1 if it failed.
+static double compile(const char *dir, long *rss) {
+    char main_file[4096], out_file[4096], err_file[4096];
+    snprintf(main_file, sizeof(main_file), "%s/main.vs", dir);
+    snprintf(out_file, sizeof(out_file), "%s/main.c", dir);
+    snprintf(err_file, sizeof(err_file), "%s/err", dir);
+    char *argv[] = {"./bin/compiler", "-o", out_file, main_file, NULL};
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 2, err_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    double start = now();
+    pid_t pid;
+    int rc = posix_spawn(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        fprintf(stderr, "Could not run %s: %s\n", argv[0], strerror(rc));
+        exit(1);
+    }
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR);
+    double elapsed = now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    *rss = usage.ru_maxrss;
+    return elapsed;
+}
+
+static void run(Scenario *s, int scale, int runs) {
+    printf("\n%s\n", s->name);
+    printf("  %8s %8s %10s %12s %10s %8s\n", "n", "lines", "seconds", "lines/sec", "rss KB", "growth");
+    double prev = 0;
+    for (int step = 0; step < STEPS; step++) {
+        int n = s->base * scale << step;
+        char dir[4096];
+        snprintf(dir, sizeof(dir), "%s/%s_%d", work_dir, s->name, n);
+        mkdir(dir, 0755);
+        lines = 0;
+        s->gen(dir, n);
+
+        double best = -1;
+        long rss = 0;
+        for (int i = 0; i < runs; i++) {
+            long r = 0;
+            double t = compile(dir, &r);
+            if (t < 0) {
+                printf("  %8d %8d  compile failed, see %s/err\n", n, lines, dir);
+                failed = 1;
+                return;
+            }
+            if (best < 0 || t < best) {
+                best = t;
+            }
+            if (r > rss) {
+                rss = r;
+            }
+        }
+        if (prev > 0) {
+            printf("  %8d %8d %10.3f %12.0f %10ld %7.2fx\n", n, lines, best, lines / best, rss, best / prev);
+        } else {
+            printf("  %8d %8d %10.3f %12.0f %10ld %8s\n", n, lines, best, lines / best, rss, "");
+        }
+        fflush(stdout);
+        prev = best;
+    }
+}
+
+static void usage(char *bin) {
+    fprintf(stderr, "Usage:\n\t%s [-runs n] [-scale k] [scenario...]\nScenarios:", bin);
+    for (int i = 0; i < NUM_SCENARIOS; i++) {
+        fprintf(stderr, " %s", scenarios[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int runs = 3;
+    int scale = 1;
+    Scenario **chosen = malloc(sizeof(Scenario *) * (NUM_SCENARIOS + argc));
+    int num_chosen = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-runs") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-scale") && i + 1 < argc) {
+            scale = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            int found = 0;
+            for (int j = 0; j < NUM_SCENARIOS; j++) {
+                if (!strcmp(argv[i], scenarios[j].name)) {
+                    chosen[num_chosen++] = &scenarios[j];
+                    found = 1;
+                }
+            }
+            if (!found) {
+                usage(argv[0]);
+            }
+        }
+    }
+    if (runs < 1 || scale < 1) {
+        usage(argv[0]);
+    }
+    if (num_chosen == 0) {
+        for (int i = 0; i < NUM_SCENARIOS; i++) {
+            chosen[num_chosen++] = &scenarios[i];
+        }
+    }
+
+    char tmpl[] = "/tmp/verse-bench-XXXXXX";
+    work_dir = mkdtemp(tmpl);
+    if (!work_dir) {
+        fprintf(stderr, "Could not create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+    printf("best of %d runs; growth is the time relative to the size before, at twice the size\n", runs);
+    for (int i = 0; i < num_chosen; i++) {
+        run(chosen[i], scale, runs);
+    }
+
+    if (failed) {
+        return 1;
+    }
+    char cmd[4200];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", work_dir);
+    return system(cmd) == 0 ? 0 : 1;
+}
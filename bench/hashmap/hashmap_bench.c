@@ -0,0 +1,177 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../src/compiler/hashmap/hashmap.h"
+#include "old_hashmap.h"
+
+// Compares the compiler's hashmap against the one it replaced, on the
+// workloads the compiler actually has: many small maps (one per scope) and a
+// few large ones (package globals, type tables), keyed by identifiers.
+//
+// usage: bin/hashmap_bench [N]
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t heap_used() {
+    return mallinfo2().uordblks;
+}
+
+static char **make_keys(int n, const char *prefix) {
+    char **keys = malloc(sizeof(char*) * n);
+    for (int i = 0; i < n; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s_%d", prefix, i);
+        keys[i] = strdup(buf);
+    }
+    return keys;
+}
+
+// lookups use a separate copy of each key so neither map can get away with a
+// pointer comparison
+static char **copy_keys(char **keys, int n) {
+    char **copy = malloc(sizeof(char*) * n);
+    for (int i = 0; i < n; i++) {
+        copy[i] = strdup(keys[i]);
+    }
+    return copy;
+}
+
+static void report(const char *name, double old_t, double new_t) {
+    printf("%-24s old %8.2fms   new %8.2fms   %5.2fx\n", name, old_t * 1000, new_t * 1000, old_t / new_t);
+}
+
+static void bench_large(int n) {
+    char **keys = make_keys(n, "ident");
+    char **lookup = copy_keys(keys, n);
+    char **missing = make_keys(n, "missing");
+    long sink = 0;
+
+    old_hashmap *old = malloc(sizeof(old_hashmap));
+    double t = now();
+    old_hashmap_init(old);
+    for (long i = 0; i < n; i++) {
+        old_hashmap_put(old, keys[i], &i, sizeof(i));
+    }
+    double old_insert = now() - t;
+
+    hashmap_t(long) new;
+    t = now();
+    hashmap_init(&new);
+    for (long i = 0; i < n; i++) {
+        hashmap_put(&new, keys[i], i);
+    }
+    double new_insert = now() - t;
+    report("insert", old_insert, new_insert);
+
+    t = now();
+    for (int r = 0; r < 10; r++) {
+        for (int i = 0; i < n; i++) {
+            sink += *(long *)old_hashmap_get(old, lookup[i]);
+        }
+    }
+    double old_hit = now() - t;
+    t = now();
+    for (int r = 0; r < 10; r++) {
+        for (int i = 0; i < n; i++) {
+            sink += *hashmap_get(&new, lookup[i]);
+        }
+    }
+    report("lookup (hit) x10", old_hit, now() - t);
+
+    t = now();
+    for (int r = 0; r < 10; r++) {
+        for (int i = 0; i < n; i++) {
+            sink += old_hashmap_get(old, missing[i]) != NULL;
+        }
+    }
+    double old_miss = now() - t;
+    t = now();
+    for (int r = 0; r < 10; r++) {
+        for (int i = 0; i < n; i++) {
+            sink += hashmap_get(&new, missing[i]) != NULL;
+        }
+    }
+    report("lookup (miss) x10", old_miss, now() - t);
+
+    // sanity check: both maps hold every key
+    if (old->size != n || new.map.size != n) {
+        fprintf(stderr, "size mismatch: old %d new %d expected %d\n", old->size, new.map.size, n);
+        exit(1);
+    }
+    old_hashmap_free(old);
+    hashmap_free(&new);
+    if (sink < 0) {
+        printf("%ld\n", sink);
+    }
+}
+
+// one map per scope, a handful of entries each, most lookups miss and fall
+// through to the parent scope
+static void bench_small(int maps, int per_map) {
+    char **keys = make_keys(per_map * 2, "local");
+    char **lookup = copy_keys(keys, per_map * 2);
+    long sink = 0;
+
+    size_t before = heap_used();
+    double t = now();
+    old_hashmap **olds = malloc(sizeof(old_hashmap*) * maps);
+    for (int m = 0; m < maps; m++) {
+        olds[m] = malloc(sizeof(old_hashmap));
+        old_hashmap_init(olds[m]);
+        for (long i = 0; i < per_map; i++) {
+            old_hashmap_put(olds[m], keys[i], &i, sizeof(i));
+        }
+        for (int i = 0; i < per_map * 2; i++) {
+            sink += old_hashmap_get(olds[m], lookup[i]) != NULL;
+        }
+    }
+    double old_t = now() - t;
+    size_t old_mem = heap_used() - before;
+    for (int m = 0; m < maps; m++) {
+        old_hashmap_free(olds[m]);
+    }
+    free(olds);
+
+    before = heap_used();
+    t = now();
+    typedef hashmap_t(long) long_map;
+    long_map *news = calloc(maps, sizeof(long_map));
+    for (int m = 0; m < maps; m++) {
+        hashmap_init(&news[m]);
+        for (long i = 0; i < per_map; i++) {
+            hashmap_put(&news[m], keys[i], i);
+        }
+        for (int i = 0; i < per_map * 2; i++) {
+            sink += hashmap_get(&news[m], lookup[i]) != NULL;
+        }
+    }
+    double new_t = now() - t;
+    size_t new_mem = heap_used() - before;
+    for (int m = 0; m < maps; m++) {
+        hashmap_free(&news[m]);
+    }
+    free(news);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%d maps of %d", maps, per_map);
+    report(name, old_t, new_t);
+    printf("%-24s old %8.2fMB   new %8.2fMB\n", "  heap", old_mem / 1e6, new_mem / 1e6);
+    if (sink < 0) {
+        printf("%ld\n", sink);
+    }
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 100000;
+    printf("%d keys\n", n);
+    bench_large(n);
+    bench_small(n / 10, 8);
+    return 0;
+}
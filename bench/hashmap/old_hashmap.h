@@ -0,0 +1,26 @@
+#ifndef OLD_HASHMAP_H
+#define OLD_HASHMAP_H
+
+#include <stdlib.h>
+#include "../../src/compiler/hashmap/hashmap.h" // for iter_t
+
+typedef struct old_hashmap_element {
+	int   in_use;
+	char *key;
+	void *value;
+} old_hashmap_element;
+
+typedef struct old_hashmap {
+	int capacity;
+	int size;
+	old_hashmap_element *data;
+} old_hashmap;
+
+void  old_hashmap_init(old_hashmap *m);
+void *old_hashmap_get(old_hashmap *m, char* key);
+int   old_hashmap_put(old_hashmap *m, char* key, void *value, size_t vsize);
+int   old_hashmap_remove(old_hashmap *m, char* key);
+void  old_hashmap_free(old_hashmap *m);
+void  old_hashmap_next(old_hashmap *m, iter_t *iter);
+
+#endif
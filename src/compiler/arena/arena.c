@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "../timing/timing.h"
+
+#define BLOCK_SIZE (1 << 20)
+#define ALIGN 16
+
+// each thread bumps through its own block, so no locking is needed
+static __thread char *cur = NULL;
+static __thread char *end = NULL;
+
+static void *alloc_or_die(size_t size) {
+    void *p = calloc(size, 1);
+    if (p == NULL) {
+        abort();
+    }
+    return p;
+}
+
+void *arena_alloc(size_t size) {
+    size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    timing_note_alloc(size);
+    // big requests get a block of their own so they don't waste the rest of
+    // the current one
+    if (size > BLOCK_SIZE / 4) {
+        return alloc_or_die(size);
+    }
+    if (cur == NULL || (size_t)(end - cur) < size) {
+        cur = alloc_or_die(BLOCK_SIZE);
+        end = cur + BLOCK_SIZE;
+    }
+    void *p = cur;
+    cur += size;
+    return p;
+}
+
+char *arena_strdup(const char *s) {
+    size_t n = strlen(s) + 1;
+    char *d = arena_alloc(n);
+    memcpy(d, s, n);
+    return d;
+}
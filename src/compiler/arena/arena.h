@@ -0,0 +1,14 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for everything that lives as long as the compiler does
+// (AST nodes, Vars, Types, Scopes, ...). Memory from here is zeroed, and is
+// never freed piecemeal -- it all goes away when the process exits.
+void *arena_alloc(size_t size);
+char *arena_strdup(const char *s);
+
+#define arena_new(T) ((T *)arena_alloc(sizeof(T)))
+
+#endif
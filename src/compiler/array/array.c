@@ -1,12 +1,14 @@
 #include <stdlib.h>
 
 #include "array.h"
+#include "../timing/timing.h"
 
 void *__array_grow(void *arr, int inc, int elem_size) {
     int doubled = array_cap(arr) * 2;
     int needed = array_len(arr) + inc;
     int new_size = doubled > needed ? doubled : needed;
     int *p = (int *) realloc(arr ? array_ptr(arr) : NULL, elem_size * new_size + sizeof(int) * 2);
+    timing_note_alloc(elem_size * new_size + sizeof(int) * 2);
     if (!arr) {
         // need to clear this
         p[0] = 0;
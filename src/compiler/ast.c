@@ -2,16 +2,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena/arena.h"
 #include "array/array.h"
+#include "intern/intern.h"
 #include "ast.h"
+#include "package.h"
 #include "token.h"
 #include "util.h"
 
 static int next_ast_id = 0;
 
+void assign_ast_ids(Ast **asts) {
+    for (int i = 0; i < array_len(asts); i++) {
+        asts[i]->id = next_ast_id++;
+    }
+}
+
 Ast *ast_alloc(AstType type) {
-    Ast *ast = malloc(sizeof(Ast));
-    ast->id = next_ast_id++;
+    Ast *ast = arena_new(Ast);
+    if (id_log) {
+        array_push(id_log->asts, ast);
+    } else {
+        ast->id = next_ast_id++;
+    }
     ast->type = type;
     ast->line = lineno();
     ast->file = current_file_name();
@@ -19,112 +32,112 @@ Ast *ast_alloc(AstType type) {
 
     switch (type) {
     case AST_LITERAL:
-        ast->lit = calloc(sizeof(AstLiteral), 1);
+        ast->lit = arena_alloc(sizeof(AstLiteral));
         break;
     case AST_DOT:
-        ast->dot = calloc(sizeof(AstDot), 1);
+        ast->dot = arena_alloc(sizeof(AstDot));
         break;
     case AST_ASSIGN:
     case AST_BINOP:
-        ast->binary = calloc(sizeof(AstBinaryOp), 1);
+        ast->binary = arena_alloc(sizeof(AstBinaryOp));
         break;
     case AST_UOP:
-        ast->unary = calloc(sizeof(AstUnaryOp), 1);
+        ast->unary = arena_alloc(sizeof(AstUnaryOp));
         break;
     case AST_IDENTIFIER:
-        ast->ident = calloc(sizeof(AstIdent), 1);
+        ast->ident = arena_alloc(sizeof(AstIdent));
         break;
     case AST_COPY:
-        ast->copy = calloc(sizeof(AstCopy), 1);
+        ast->copy = arena_alloc(sizeof(AstCopy));
         break;
     case AST_DECL:
-        ast->decl = calloc(sizeof(AstDecl), 1);
+        ast->decl = arena_alloc(sizeof(AstDecl));
         break;
     case AST_ANON_FUNC_DECL:
     case AST_EXTERN_FUNC_DECL:
     case AST_FUNC_DECL:
-        ast->fn_decl = calloc(sizeof(AstFnDecl), 1);
+        ast->fn_decl = arena_alloc(sizeof(AstFnDecl));
         break;
     case AST_CALL:
-        ast->call = calloc(sizeof(AstCall), 1);
+        ast->call = arena_alloc(sizeof(AstCall));
         break;
     case AST_INDEX:
-        ast->index = calloc(sizeof(AstIndex), 1);
+        ast->index = arena_alloc(sizeof(AstIndex));
         break;
     case AST_SLICE:
-        ast->slice = calloc(sizeof(AstSlice), 1);
+        ast->slice = arena_alloc(sizeof(AstSlice));
         break;
     case AST_CONDITIONAL:
-        ast->cond = calloc(sizeof(AstConditional), 1);
+        ast->cond = arena_alloc(sizeof(AstConditional));
         break;
     case AST_RETURN:
-        ast->ret = calloc(sizeof(AstReturn), 1);
+        ast->ret = arena_alloc(sizeof(AstReturn));
         break;
     case AST_TYPE_DECL:
-        ast->type_decl = calloc(sizeof(AstTypeDecl), 1);
+        ast->type_decl = arena_alloc(sizeof(AstTypeDecl));
         break;
     case AST_BLOCK:
-        ast->block = calloc(sizeof(AstBlock), 1);
+        ast->block = arena_alloc(sizeof(AstBlock));
         ast->block->startline = lineno();
         ast->block->file = ast->file;
         break;
     case AST_WHILE:
-        ast->while_loop = calloc(sizeof(AstWhile), 1);
+        ast->while_loop = arena_alloc(sizeof(AstWhile));
         break;
     case AST_FOR:
-        ast->for_loop = calloc(sizeof(AstFor), 1);
+        ast->for_loop = arena_alloc(sizeof(AstFor));
         break;
     case AST_ANON_SCOPE:
-        ast->anon_scope = calloc(sizeof(AstAnonScope), 1);
+        ast->anon_scope = arena_alloc(sizeof(AstAnonScope));
         break;
     case AST_BREAK:
     case AST_CONTINUE:
         // Don't need any extra stuff
         break;
     case AST_CAST:
-        ast->cast = calloc(sizeof(AstCast), 1);
+        ast->cast = arena_alloc(sizeof(AstCast));
         break;
     case AST_DIRECTIVE:
-        ast->directive = calloc(sizeof(AstDirective), 1);
+        ast->directive = arena_alloc(sizeof(AstDirective));
         break;
     case AST_TYPEINFO:
-        ast->typeinfo = calloc(sizeof(AstTypeInfo), 1);
+        ast->typeinfo = arena_alloc(sizeof(AstTypeInfo));
         break;
     case AST_ENUM_DECL:
-        ast->enum_decl = calloc(sizeof(AstEnumDecl), 1);
+        ast->enum_decl = arena_alloc(sizeof(AstEnumDecl));
         break;
     case AST_USE:
-        ast->use = calloc(sizeof(AstUse), 1);
+        ast->use = arena_alloc(sizeof(AstUse));
         break;
     case AST_IMPORT:
-        ast->import = calloc(sizeof(AstImport), 1);
+        ast->import = arena_alloc(sizeof(AstImport));
         break;
     case AST_TYPE_OBJ:
-        ast->type_obj = calloc(sizeof(AstTypeObj), 1);
+        ast->type_obj = arena_alloc(sizeof(AstTypeObj));
         break;
     case AST_SPREAD:
-        ast->spread = calloc(sizeof(AstSpread), 1);
+        ast->spread = arena_alloc(sizeof(AstSpread));
         break;
     case AST_NEW:
-        ast->new = calloc(sizeof(AstNew), 1);
+        ast->new = arena_alloc(sizeof(AstNew));
         break;
     case AST_DEFER:
-        ast->defer = calloc(sizeof(AstDefer), 1);
+        ast->defer = arena_alloc(sizeof(AstDefer));
         break;
     case AST_IMPL:
-        ast->impl = calloc(sizeof(AstImpl), 1);
+        ast->impl = arena_alloc(sizeof(AstImpl));
         break;
     case AST_METHOD:
-        ast->method = calloc(sizeof(AstMethod), 1);
+        ast->method = arena_alloc(sizeof(AstMethod));
         break;
     case AST_TYPE_IDENT:
-        ast->type_ident = calloc(sizeof(AstTypeIdent), 1);
+        ast->type_ident = arena_alloc(sizeof(AstTypeIdent));
         break;
     case AST_PACKAGE:
-        ast->pkg = calloc(sizeof(AstPackage), 1);
+        ast->pkg = arena_alloc(sizeof(AstPackage));
         break;
     case AST_COMMENT:
-        ast->comment = calloc(sizeof(AstComment), 1);
+        ast->comment = arena_alloc(sizeof(AstComment));
         break;
     }
     return ast;
@@ -138,7 +151,6 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
 
     switch (ast->type) {
     case AST_LITERAL:
-        cp->lit = calloc(sizeof(AstLiteral), 1);
         *cp->lit = *ast->lit;
         switch (cp->lit->lit_type) {
         case ARRAY_LIT:
@@ -161,32 +173,26 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
         }
         break;
     case AST_DOT:
-        cp->dot = calloc(sizeof(AstDot), 1);
         cp->dot->object = copy_ast(scope, ast->dot->object);
         cp->dot->member_name = ast->dot->member_name;
         break;
     case AST_ASSIGN:
     case AST_BINOP:
-        cp->binary = calloc(sizeof(AstBinaryOp), 1);
         cp->binary->op = ast->binary->op;
         cp->binary->left = copy_ast(scope, ast->binary->left);
         cp->binary->right = copy_ast(scope, ast->binary->right);
         break;
     case AST_UOP:
-        cp->unary = calloc(sizeof(AstUnaryOp), 1);
         cp->unary->op = ast->unary->op;
         cp->unary->object = copy_ast(scope, ast->unary->object);
         break;
     case AST_IDENTIFIER:
-        cp->ident = calloc(sizeof(AstIdent), 1);
         cp->ident->varname = ast->ident->varname;
         break;
     case AST_COPY:
-        cp->copy = calloc(sizeof(AstCopy), 1);
         cp->copy->expr = copy_ast(scope, ast->copy->expr);
         break;
     case AST_DECL:
-        cp->decl = calloc(sizeof(AstDecl), 1);
         cp->decl->global = ast->decl->global;
         cp->decl->var = copy_var(scope, ast->decl->var);
         if (ast->decl->init != NULL) {
@@ -196,7 +202,6 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
     case AST_ANON_FUNC_DECL:
     case AST_EXTERN_FUNC_DECL:
     case AST_FUNC_DECL:
-        cp->fn_decl = calloc(sizeof(AstFnDecl), 1);
         cp->fn_decl->var = copy_var(scope, ast->fn_decl->var);
         cp->fn_decl->anon = ast->fn_decl->anon;
         for (int i = 0; i < array_len(ast->fn_decl->args); i++) {
@@ -205,7 +210,6 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
         cp->fn_decl->body = copy_ast_block(scope, ast->fn_decl->body);
         break;
     case AST_CALL:
-        cp->call = calloc(sizeof(AstCall), 1);
         cp->call->fn = copy_ast(scope, ast->call->fn);
         for (int i = 0; i < array_len(ast->call->args); i++) {
             array_push(cp->call->args, copy_ast(scope, ast->call->args[i]));
@@ -215,12 +219,10 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
         }
         break;
     case AST_INDEX:
-        cp->index = calloc(sizeof(AstIndex), 1);
         cp->index->object = copy_ast(scope, ast->index->object);
         cp->index->index = copy_ast(scope, ast->index->index);
         break;
     case AST_SLICE:
-        cp->slice = calloc(sizeof(AstSlice), 1);
         cp->slice->object = copy_ast(scope, ast->slice->object);
         if (ast->slice->offset != NULL) {
             cp->slice->offset = copy_ast(scope, ast->slice->offset);
@@ -230,7 +232,6 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
         }
         break;
     case AST_CONDITIONAL:
-        cp->cond = calloc(sizeof(AstConditional), 1);
         if (ast->cond->initializer) {
             cp->cond->initializer = copy_ast(scope, ast->cond->initializer);
         }
@@ -241,18 +242,15 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
         }
         break;
     case AST_RETURN:
-        cp->ret = calloc(sizeof(AstReturn), 1);
         cp->ret->expr = copy_ast(scope, ast->ret->expr);
         break;
     case AST_TYPE_DECL:
-        cp->type_decl = calloc(sizeof(AstTypeDecl), 1);
         // This will have to happen before first_pass
         break;
     case AST_BLOCK:
         cp->block = copy_ast_block(scope, ast->block);
         break;
     case AST_WHILE:
-        cp->while_loop = calloc(sizeof(AstWhile), 1);
         if (ast->while_loop->initializer) {
             cp->while_loop->initializer = copy_ast(scope, ast->while_loop->initializer);
         }
@@ -260,7 +258,6 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
         cp->while_loop->body = copy_ast_block(scope, ast->while_loop->body);
         break;
     case AST_FOR:
-        cp->for_loop = calloc(sizeof(AstFor), 1);
         cp->for_loop->itervar = copy_var(scope, ast->for_loop->itervar);
         if (ast->for_loop->index != NULL) {
             cp->for_loop->index = copy_var(scope, ast->for_loop->index);
@@ -276,29 +273,24 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
     case AST_CONTINUE:
         break;
     case AST_CAST:
-        cp->cast = calloc(sizeof(AstCast), 1);
         cp->cast->cast_type = copy_type(scope, ast->cast->cast_type);
         cp->cast->object = copy_ast(scope, ast->cast->object);
         break;
     case AST_DIRECTIVE:
-        cp->directive = calloc(sizeof(AstDirective), 1);
         cp->directive->name = ast->directive->name;
         if (ast->directive->object != NULL) {
             cp->directive->object = copy_ast(scope, ast->directive->object);
         }
         break;
     case AST_TYPEINFO:
-        cp->typeinfo = calloc(sizeof(AstTypeInfo), 1);
         cp->typeinfo->typeinfo_target = copy_type(scope, ast->typeinfo->typeinfo_target);
         break;
     case AST_ENUM_DECL:
-        cp->enum_decl = calloc(sizeof(AstEnumDecl), 1);
         cp->enum_decl->enum_name = ast->enum_decl->enum_name;
         cp->enum_decl->enum_type = copy_type(scope, ast->enum_decl->enum_type);
         // TODO: wtf
         break;
     case AST_USE:
-        cp->use = calloc(sizeof(AstUse), 1);
         cp->use->object = copy_ast(scope, ast->use->object);
         break;
     case AST_IMPORT:
@@ -306,39 +298,32 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
         break;
         break;
     case AST_TYPE_OBJ:
-        cp->type_obj = calloc(sizeof(AstTypeObj), 1);
         cp->type_obj->t = copy_type(scope, ast->type_obj->t);
         break;
     case AST_SPREAD:
-        cp->spread = calloc(sizeof(AstSpread), 1);
         cp->spread->object = copy_ast(scope, ast->spread->object);
         break;
     case AST_NEW:
-        cp->new = calloc(sizeof(AstNew), 1);
         if (ast->new->count != NULL) {
             cp->new->count = copy_ast(scope, ast->new->count);
         }
         cp->new->type = copy_type(scope, ast->new->type);
         break;
     case AST_DEFER:
-        cp->defer = calloc(sizeof(AstDefer), 1);
         cp->defer->call = copy_ast(scope, ast->defer->call);
         break;
     case AST_IMPL:
-        cp->impl = calloc(sizeof(AstImpl), 1);
         cp->impl->type = copy_type(scope, ast->impl->type);
         for (int i = 0; i < array_len(ast->impl->methods); i++) {
             array_push(cp->impl->methods, copy_ast(scope, ast->impl->methods[i]));
         }
         break;
     case AST_METHOD:
-        cp->method = calloc(sizeof(AstMethod), 1);
         cp->method->recv = copy_ast(scope, ast->method->recv);
         cp->method->name = ast->method->name;
         cp->method->decl = ast->method->decl;
         break;
     case AST_TYPE_IDENT:
-        cp->type_ident = calloc(sizeof(AstTypeIdent), 1);
         cp->type_ident->type = copy_type(scope, ast->type_ident->type);
         break;
     case AST_COMMENT:
@@ -350,7 +335,7 @@ Ast *copy_ast(Scope *scope, Ast *ast) {
 }
 
 AstBlock *copy_ast_block(Scope *scope, AstBlock *block) {
-    AstBlock *b = calloc(sizeof(AstBlock), 1);
+    AstBlock *b = arena_new(AstBlock);
     b->startline = block->startline;
     b->endline = block->endline;
     b->file = block->file;
@@ -375,15 +360,28 @@ int needs_temp_var(Ast *ast) {
     case AST_UOP:
     case AST_CALL:
     case AST_LITERAL:
-    case AST_SLICE:
     case AST_INDEX:
         return is_dynamic(ast->var_type);
+    case AST_SLICE:
+        return !ast->slice->borrowed && is_dynamic(ast->var_type);
     default:
         break;
     }
     return 0;
 }
 
+// A part of a string + chain (not a nested + of the chain itself) that is
+// a temporary the concatenation has to free afterward.
+int needs_concat_temp_var(Ast *ast) {
+    if (ast->type == AST_LITERAL || is_lvalue(ast)) {
+        return 0;
+    }
+    if (ast->type == AST_BINOP && ast->binary->op == OP_PLUS) {
+        return 0;
+    }
+    return needs_temp_var(ast);
+}
+
 int is_lvalue(Ast *ast) {
     return ast->type == AST_IDENTIFIER ||
         ast->type == AST_DOT ||
@@ -415,14 +413,14 @@ Ast *make_ast_string(char *str) {
 Ast *make_ast_id(Var *var, char *name) {
     Ast *id = ast_alloc(AST_IDENTIFIER);
     id->ident->var = var;
-    id->ident->varname = name;
+    id->ident->varname = intern(name);
     return id;
 }
 
 Ast *make_ast_dot_op(Ast *object, char *member_name) {
     Ast *ast = ast_alloc(AST_DOT);
     ast->dot->object = object;
-    ast->dot->member_name = member_name;
+    ast->dot->member_name = intern(member_name);
     return ast;
 }
 
@@ -457,6 +455,14 @@ Ast *make_ast_slice(Ast *object, Ast *offset, Ast *length) {
     return s;
 }
 
+// polymorphs have no name of their own, so go by that of their definition
+char *fn_decl_name(AstFnDecl *decl) {
+    if (decl->polymorph_of) {
+        return decl->polymorph_of->var->name;
+    }
+    return decl->var->name;
+}
+
 char *get_varname(Ast *ast) {
     switch (ast->type) {
     case AST_DOT: {
@@ -52,6 +52,7 @@ typedef struct AstTypeInfo {
 typedef struct AstIdent {
     Var *var;
     char *varname; // TODO not needed?
+    int moved; // the owner's last use: its value is handed on, not copied (see moves.h)
 } AstIdent;
 
 typedef struct AstDecl {
@@ -93,6 +94,9 @@ typedef struct AstSlice {
     Ast *object;
     Ast *offset;
     Ast *length;
+    // string slices only: set when the slice is read right where it's made,
+    // so it can be a view of the string rather than a copy
+    int borrowed;
 } AstSlice;
 
 typedef struct AstIndex {
@@ -114,6 +118,9 @@ typedef struct AstFnDecl {
     Scope     *scope;
     AstBlock  *body;
     Polymorph **polymorphs;
+    Polymorph ***polymorph_buckets; // polymorphs bucketed by hash of their arg types
+    int        polymorph_hits;
+    int        polymorph_misses;
     struct AstFnDecl *polymorph_of;
     // TODO: sloppy, clean this up
     int        ext_autocast;
@@ -167,6 +174,7 @@ typedef struct AstFor {
     Ast *iterable;
     AstBlock *body;
     char by_reference;
+    char borrowed; // by value, but the body only reads the element, so it isn't copied
 } AstFor;
 
 typedef struct AstAnonScope {
@@ -228,6 +236,7 @@ typedef struct AstComment {
 } AstComment;
 
 Ast *ast_alloc(AstType type);
+void assign_ast_ids(Ast **asts);
 Ast *deep_copy(Ast *ast);
 Ast *copy_ast(Scope *scope, Ast *ast);
 AstBlock *copy_ast_block(Scope *scope, AstBlock *block);
@@ -244,8 +253,10 @@ Ast *make_ast_binop(int op, Ast *left, Ast *right);
 Ast *make_ast_slice(Ast *inner, Ast *offset, Ast *length);
 
 char *get_varname(Ast *ast);
+char *fn_decl_name(AstFnDecl *decl);
 
 int needs_temp_var(Ast *ast);
+int needs_concat_temp_var(Ast *ast);
 int is_lvalue(Ast *ast);
 //int is_literal(Ast *ast);
 // TODO: clarify the purpose of these 
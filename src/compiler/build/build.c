@@ -0,0 +1,195 @@
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "build.h"
+#include "../array/array.h"
+
+extern char **environ;
+
+// debug matches what the verse script has always used; nothing defines
+// NDEBUG, since the builtin assert is C's assert
+static Profile profiles[] = {
+    {"debug",   {"-g", "-std=c99"}},
+    {"release", {"-O2", "-std=c99", "-flto", "-fno-plt"}},
+    {"native",  {"-O3", "-march=native", "-std=c99", "-flto", "-fno-plt"}},
+};
+
+Profile *find_profile(char *name) {
+    for (int i = 0; i < sizeof(profiles) / sizeof(Profile); i++) {
+        if (!strcmp(profiles[i].name, name)) {
+            return &profiles[i];
+        }
+    }
+    return NULL;
+}
+
+char *profile_flags_string(Profile *p) {
+    int len = 0;
+    for (int i = 0; p->flags[i]; i++) {
+        len += strlen(p->flags[i]) + 1;
+    }
+    char *out = calloc(len + 1, sizeof(char));
+    for (int i = 0; p->flags[i]; i++) {
+        if (i > 0) {
+            strcat(out, " ");
+        }
+        strcat(out, p->flags[i]);
+    }
+    return out;
+}
+
+static char *c_compiler() {
+    char *cc = getenv("CC");
+    return (cc && *cc) ? cc : "gcc";
+}
+
+static pid_t spawn(char **argv, int verbose) {
+    if (verbose) {
+        for (int i = 0; argv[i]; i++) {
+            fprintf(stderr, i ? " %s" : "%s", argv[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (err) {
+        fprintf(stderr, "Could not run '%s': %s\n", argv[0], strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+static int succeeded(int status) {
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int run(char **argv, int verbose) {
+    pid_t pid = spawn(argv, verbose);
+    if (pid < 0) {
+        return 0;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return succeeded(status);
+}
+
+static int newer(char *a, char *b) {
+    struct stat sa, sb;
+    if (stat(a, &sa) || stat(b, &sb)) {
+        return 0;
+    }
+    if (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec) {
+        return sa.st_mtim.tv_sec > sb.st_mtim.tv_sec;
+    }
+    return sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec;
+}
+
+static char **base_args(Profile *p) {
+    char **args = NULL;
+    array_push(args, c_compiler());
+    for (int i = 0; p->flags[i]; i++) {
+        array_push(args, p->flags[i]);
+    }
+    return args;
+}
+
+static char *object_path(char *c_file) {
+    int len = strlen(c_file);
+    char *o = malloc(sizeof(char) * (len + 3));
+    strcpy(o, c_file);
+    if (len > 2 && !strcmp(o + len - 2, ".c")) {
+        o[len - 1] = 'o';
+    } else {
+        strcat(o, ".o");
+    }
+    return o;
+}
+
+// Waits for any one compiler to finish, returning 0 if it failed.
+static int wait_any() {
+    int status;
+    while (wait(&status) < 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return succeeded(status);
+}
+
+// Compiles each C file to an object, running up to jobs compilers at once.
+static int compile_objects(Profile *p, char **c_files, char **objects, char *header, int jobs, int verbose) {
+    int ok = 1;
+    int running = 0;
+    for (int i = 0; ok && i < array_len(c_files); i++) {
+        if (newer(objects[i], c_files[i]) && (!header || newer(objects[i], header))) {
+            continue;
+        }
+        if (running >= jobs) {
+            running--;
+            if (!(ok = wait_any())) {
+                break;
+            }
+        }
+        char **args = base_args(p);
+        array_push(args, "-c");
+        array_push(args, c_files[i]);
+        array_push(args, "-o");
+        array_push(args, objects[i]);
+        array_push(args, NULL);
+        pid_t pid = spawn(args, verbose);
+        array_free(args);
+        if (pid < 0) {
+            ok = 0;
+        } else {
+            running++;
+        }
+    }
+    for (; running > 0; running--) {
+        ok = wait_any() && ok;
+    }
+    return ok;
+}
+
+int build_executable(Profile *p, char **c_files, char *header, char **asm_files, char **libs, char *exe, int jobs, int verbose) {
+    char **inputs = c_files;
+    char **objects = NULL;
+    if (array_len(c_files) > 1) {
+        for (int i = 0; i < array_len(c_files); i++) {
+            array_push(objects, object_path(c_files[i]));
+        }
+        if (!compile_objects(p, c_files, objects, header, jobs, verbose)) {
+            return 1;
+        }
+        inputs = objects;
+    }
+
+    char **args = base_args(p);
+    for (int i = 0; i < array_len(asm_files); i++) {
+        array_push(args, asm_files[i]);
+    }
+    for (int i = 0; i < array_len(inputs); i++) {
+        array_push(args, inputs[i]);
+    }
+    array_push(args, "-o");
+    array_push(args, exe);
+    for (int i = 0; i < array_len(libs); i++) {
+        array_push(args, libs[i]);
+    }
+    array_push(args, NULL);
+    int ok = run(args, verbose);
+    array_free(args);
+    for (int i = 0; i < array_len(objects); i++) {
+        free(objects[i]);
+    }
+    array_free(objects);
+    return ok ? 0 : 1;
+}
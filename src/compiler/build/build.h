@@ -0,0 +1,23 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+// Runs the C compiler ($CC, or gcc) on generated code.
+
+#define MAX_PROFILE_FLAGS 8
+
+typedef struct Profile {
+    char *name;
+    char *flags[MAX_PROFILE_FLAGS];
+} Profile;
+
+// Returns the -O profile with this name, or NULL.
+Profile *find_profile(char *name);
+char *profile_flags_string(Profile *p);
+
+// Compiles c_files together with asm_files and links them into exe. A single
+// C file is built in one step; otherwise each is compiled to an object next
+// to it, up to jobs at a time, skipping those whose object is newer than both
+// the C file and header (if given). Returns 0 on success.
+int build_executable(Profile *p, char **c_files, char *header, char **asm_files, char **libs, char *exe, int jobs, int verbose);
+
+#endif
@@ -5,34 +5,69 @@
 #include <assert.h>
 
 #include "array/array.h"
+#include "hashmap/hashmap.h"
+#include "outbuf/outbuf.h"
+#include "trace/trace.h"
 #include "typechecking.h"
 #include "codegen.h"
+#include "moves.h"
 #include "parse.h"
 #include "scope.h"
 
 static int _indent = 0;
 static int _static_array_copy_depth = 0;
 
-static FILE *output;
+static OutBuf out;
+// the current unit's string literals (see codegen_begin_literals)
+static hashmap_t(int) literal_ids;
+static OutBuf literal_defs;
+static long literals_at = -1; // where in out their definitions go
+static int num_literals = 0;
+// set when the program is split into several C files (see codegen_set_split)
+static int split_units = 0;
 
+// Output is buffered until codegen_flush, or until the output is changed.
 void codegen_set_output(FILE *f) {
-    output = f;
+    codegen_flush();
+    outbuf_set_file(&out, f);
 }
 
-#define write_fmt(...) fprintf(output, __VA_ARGS__)
+void codegen_flush() {
+    if (literals_at >= 0 && literal_defs.len) {
+        outbuf_insert(&out, literals_at, literal_defs.data, literal_defs.len);
+    }
+    literals_at = -1;
+    outbuf_flush(&out);
+}
+
+// Struct declarations go in a header shared by every unit, so their helper
+// functions have to be static there.
+void codegen_set_split(int split) {
+    split_units = split;
+}
+
+#define write_fmt(...) outbuf_printf(&out, __VA_ARGS__)
+// the rest skip formatting; write_lit only takes string literals
+#define write_lit(s) outbuf_lit(&out, s)
+#define write_str(s) outbuf_puts(&out, s)
+#define write_int(n) outbuf_int(&out, n)
+#define write_quoted(s) outbuf_quoted(&out, s)
+
+static void write_var_name(int id) {
+    write_lit("_vs_");
+    write_int(id);
+}
 
 int write_bytes(const char *b, ...) {
     va_list args;
     va_start(args, b);
-    int ret = vfprintf(output, b, args);
+    int ret = outbuf_vprintf(&out, b, args);
     va_end(args);
     return ret;
 }
 
 void indent() {
-    for (int i = 0; i < _indent; i++) {
-        write_fmt("    ");
-    }
+    outbuf_indent(&out, _indent);
 }
 
 void change_indent(int n) {
@@ -49,7 +84,7 @@ void emit_entrypoint() {
 }
 
 void emit_init_routine(Package **packages, Scope *root_scope, Ast *root, Var *main_var) {
-    write_fmt("int _verse_init() {\n");
+    write_lit("int _verse_init() {\n");
     change_indent(1);
 
     for (int i = 0; i < array_len(packages); i++) {
@@ -66,7 +101,7 @@ void emit_init_routine(Package **packages, Scope *root_scope, Ast *root, Var *ma
     if (main_var != NULL) {
         write_fmt("    return _vs_%d();\n}", main_var->id);
     } else {
-        write_fmt("    return 0;\n}");
+        write_lit("    return 0;\n}");
     }
 }
 
@@ -91,7 +126,7 @@ void recursively_declare_types(int *declared_type_ids, Scope *root_scope, Type *
 
 void emit_typeinfo_init_routine(Scope *root_scope, Type **builtins, Type **used_types) {
     int *initted_type_ids = NULL;
-    write_fmt("void _verse_init_typeinfo() {\n");
+    write_lit("void _verse_init_typeinfo() {\n");
     change_indent(1);
     for (int i = 0; i < array_len(builtins); i++) {
         emit_typeinfo_init(root_scope, builtins[i]);
@@ -110,11 +145,54 @@ void emit_typeinfo_init_routine(Scope *root_scope, Type **builtins, Type **used_
         }
     }
     change_indent(-1);
-    write_fmt("}\n");
+    write_lit("}\n");
     array_free(initted_type_ids);
 }
 
-void emit_typeinfo_decl(Scope *scope, Type *t) {
+static void write_string_struct(OutBuf *b, char *str) {
+    int len = strlen(str);
+    outbuf_printf(b, "{.length=%d,.literal=1,.%s=\"", len, len <= STRING_INLINE ? "small" : "bytes");
+    outbuf_quoted(b, str);
+    outbuf_lit(b, "\"}");
+}
+
+// a static string initializer
+void emit_string_struct(char *str) {
+    write_string_struct(&out, str);
+}
+
+// Each distinct string literal in a unit is defined once, as static data,
+// where codegen_begin_literals was called; uses are just copies of it. The
+// definitions are put in place when the unit is flushed.
+void codegen_begin_literals() {
+    hashmap_free(&literal_ids);
+    literal_defs.len = 0;
+    num_literals = 0;
+    literals_at = out.len;
+}
+
+void emit_string_literal(char *str) {
+    if (literals_at < 0) {
+        write_lit("((struct string_type)");
+        emit_string_struct(str);
+        write_lit(")");
+        return;
+    }
+    int id;
+    if (hashmap_get(&literal_ids, str)) {
+        id = *literal_ids.ref;
+    } else {
+        id = num_literals++;
+        hashmap_put(&literal_ids, str, id);
+        outbuf_printf(&literal_defs, "static const struct string_type _str%d = ", id);
+        write_string_struct(&literal_defs, str);
+        outbuf_lit(&literal_defs, ";\n");
+    }
+    write_lit("_str");
+    write_int(id);
+}
+
+static void typeinfo_decl(Type *t, int ext) {
     int id = t->id;
     int typeinfo_type_id = get_typeinfo_type_id();
     assert(t->resolved);
@@ -124,22 +202,29 @@ void emit_typeinfo_decl(Scope *scope, Type *t) {
 
     switch (r->comp) {
     case STRUCT:
-        write_fmt("struct _type_vs_%d _type_info%d_members[%d];\n", get_structmember_type_id(), id, array_len(r->st.member_types));
+        write_fmt("%sstruct _type_vs_%d _type_info%d_members[%d];\n", ext ? "extern " : "", get_structmember_type_id(), id, array_len(r->st.member_types));
         break;
     case FUNC:
-        write_fmt("struct _type_vs_%d *_type_info%d_args[%d];\n", typeinfo_type_id, id, array_len(r->fn.args));
+        write_fmt("%sstruct _type_vs_%d *_type_info%d_args[%d];\n", ext ? "extern " : "", typeinfo_type_id, id, array_len(r->fn.args));
         break;
     case ENUM:
+        if (ext) {
+            write_fmt("extern struct string_type _type_info%d_members[%d];\n", id, array_len(r->en.member_values));
+            write_fmt("extern int64_t _type_info%d_values[%d];\n", id, array_len(r->en.member_values));
+            break;
+        }
         write_fmt("struct string_type _type_info%d_members[%d] = {\n", id, array_len(r->en.member_values));
         for (int i = 0; i < array_len(r->en.member_names); i++) {
-            write_fmt("  {%ld, \"%s\"},\n", strlen(r->en.member_names[i]), r->en.member_names[i]);
+            write_lit("  ");
+            emit_string_struct(r->en.member_names[i]);
+            write_lit(",\n");
         }
-        write_fmt("};\n");
+        write_lit("};\n");
         write_fmt("int64_t _type_info%d_values[%d] = {\n", id, array_len(r->en.member_values));
         for (int i = 0; i < array_len(r->en.member_values); i++) {
             write_fmt(" %ld,\n", r->en.member_values[i]);
         }
-        write_fmt("};\n");
+        write_lit("};\n");
         break;
     case BASIC:
         switch (r->data->base) {
@@ -156,17 +241,19 @@ void emit_typeinfo_decl(Scope *scope, Type *t) {
     default:
         break;
     }
-    write_fmt("struct _type_vs_%d _type_info%d;\n", base_id, id);
+    write_fmt("%sstruct _type_vs_%d _type_info%d;\n", ext ? "extern " : "", base_id, id);
 }
 
-void indent();
+void emit_typeinfo_decl(Scope *scope, Type *t) {
+    typeinfo_decl(t, 0);
+}
 
-void emit_string_struct(char *str) {
-    write_fmt("{%ld,\"", strlen(str));
-    print_quoted_string(output, str);
-    write_fmt("\"}");
+void emit_extern_typeinfo_decl(Scope *scope, Type *t) {
+    typeinfo_decl(t, 1);
 }
 
+void indent();
+
 void emit_typeinfo_init(Scope *scope, Type *t) {
     int id = t->id;
     int typeinfo_type_id = get_typeinfo_type_id();
@@ -233,11 +320,11 @@ void emit_typeinfo_init(Scope *scope, Type *t) {
 
         Type *ret = r->fn.ret[0];
         if (ret->resolved->comp == BASIC && ret->resolved->data->base == VOID_T) {
-            write_fmt("NULL, ");
+            write_lit("NULL, ");
         } else {
             write_fmt("(struct _type_vs_%d *)&_type_info%d, ", typeinfo_type_id, ret->id);
         }
-        write_fmt("0};\n");
+        write_lit("0};\n");
         break;
     }
     case BASIC: {
@@ -259,19 +346,19 @@ void emit_typeinfo_init(Scope *scope, Type *t) {
             indent();
             write_fmt("_type_info%d = (struct _type_vs_%d){%d, 12, ", id, typeinfo_type_id, id);
             emit_string_struct(name);
-            write_fmt("};\n");
+            write_lit("};\n");
             break;
         case STRING_T:
             indent();
             write_fmt("_type_info%d = (struct _type_vs_%d){%d, 6, ", id, typeinfo_type_id, id);
             emit_string_struct(name);
-            write_fmt("};\n");
+            write_lit("};\n");
             break;
         case BOOL_T:
             indent();
             write_fmt("_type_info%d = (struct _type_vs_%d){%d, 2, ", id, typeinfo_type_id, id);
             emit_string_struct(name);
-            write_fmt("};\n");
+            write_lit("};\n");
             break;
         }
     }
@@ -291,9 +378,9 @@ void emit_temp_var(Scope *scope, Ast *ast, int ref) {
     if (r->comp == REF) {
         Type *inner = r->ref.inner;
         if (inner->resolved->comp == STATIC_ARRAY) {
-            write_fmt("(");
+            write_lit("(");
             emit_type(inner);
-            write_fmt("*)");
+            write_lit("*)");
         }
     }
     compile(scope, ast);
@@ -303,32 +390,32 @@ void emit_temp_var(Scope *scope, Ast *ast, int ref) {
 void emit_string_comparison(Scope *scope, Ast *ast) {
     AstBinaryOp *bin = ast->binary;
     if (bin->op == OP_NEQUALS) {
-        write_fmt("!");
+        write_lit("!");
     } else if (bin->op != OP_EQUALS) {
         error(ast->line, ast->file, "Comparison of type '%s' is not valid for type 'string'.", op_to_str(bin->op));
     }
     if (bin->left->type == AST_LITERAL && bin->right->type == AST_LITERAL) {
-        write_fmt("%d", strcmp(bin->left->lit->string_val, bin->right->lit->string_val) ? 0 : 1);
+        write_int(strcmp(bin->left->lit->string_val, bin->right->lit->string_val) ? 0 : 1);
         return;
     }
     if (bin->left->type == AST_LITERAL) {
-        write_fmt("streq_lit(");
+        write_lit("streq_lit(");
         compile(scope, bin->right);
-        write_fmt(",\"");
-        print_quoted_string(output, bin->left->lit->string_val);
+        write_lit(",\"");
+        write_quoted(bin->left->lit->string_val);
         write_fmt("\",%d)", escaped_strlen(bin->left->lit->string_val));
     } else if (bin->right->type == AST_LITERAL) {
-        write_fmt("streq_lit(");
+        write_lit("streq_lit(");
         compile(scope, bin->left);
-        write_fmt(",\"");
-        print_quoted_string(output, bin->right->lit->string_val);
+        write_lit(",\"");
+        write_quoted(bin->right->lit->string_val);
         write_fmt("\",%d)", escaped_strlen(bin->right->lit->string_val));
     } else {
-        write_fmt("streq(");
+        write_lit("streq(");
         compile(scope, bin->left);
-        write_fmt(",");
+        write_lit(",");
         compile(scope, bin->right);
-        write_fmt(")");
+        write_lit(")");
     }
 }
 
@@ -338,14 +425,53 @@ void emit_comparison(Scope *scope, Ast *ast) {
         emit_string_comparison(scope, ast);
         return;
     }
-    write_fmt("(");
+    write_lit("(");
     compile(scope, ast->binary->left);
     write_fmt(" %s ", op_to_str(ast->binary->op));
     compile(scope, ast->binary->right);
-    write_fmt(")");
+    write_lit(")");
+}
+
+static int is_string_concat(Ast *ast) {
+    return ast->type == AST_BINOP && ast->binary->op == OP_PLUS && is_string(ast->var_type);
+}
+
+static void collect_concat_parts(Ast *ast, Ast ***parts) {
+    if (is_string_concat(ast)) {
+        collect_concat_parts(ast->binary->left, parts);
+        collect_concat_parts(ast->binary->right, parts);
+    } else {
+        array_push(*parts, ast);
+    }
+}
+
+static void compile_concat_part(Scope *scope, Ast *part) {
+    if (needs_concat_temp_var(part)) {
+        emit_temp_var(scope, part, 0);
+    } else {
+        compile(scope, part);
+    }
 }
 
 void emit_string_binop(Scope *scope, Ast *ast) {
+    // a + b + c + ... is built in one allocation rather than a new string
+    // (copying everything before it) per +
+    Ast **parts = NULL;
+    collect_concat_parts(ast, &parts);
+    if (array_len(parts) > 2) {
+        write_fmt("concat_strings(%d,(struct string_type[]){", array_len(parts));
+        for (int i = 0; i < array_len(parts); i++) {
+            if (i > 0) {
+                write_lit(",");
+            }
+            compile_concat_part(scope, parts[i]);
+        }
+        write_lit("})");
+        array_free(parts);
+        return;
+    }
+    array_free(parts);
+
     switch (ast->binary->right->type) {
     case AST_CALL: // is this right? need to do anything else?
     case AST_IDENTIFIER:
@@ -354,17 +480,17 @@ void emit_string_binop(Scope *scope, Ast *ast) {
     case AST_SLICE:
     case AST_UOP:
     case AST_BINOP:
-        write_fmt("append_string(");
-        compile(scope, ast->binary->left);
-        write_fmt(",");
-        compile(scope, ast->binary->right);
-        write_fmt(")");
+        write_lit("append_string(");
+        compile_concat_part(scope, ast->binary->left);
+        write_lit(",");
+        compile_concat_part(scope, ast->binary->right);
+        write_lit(")");
         break;
     case AST_LITERAL:
-        write_fmt("append_string_lit(");
-        compile(scope, ast->binary->left);
-        write_fmt(",\"");
-        print_quoted_string(output, ast->binary->right->lit->string_val);
+        write_lit("append_string_lit(");
+        compile_concat_part(scope, ast->binary->left);
+        write_lit(",\"");
+        write_quoted(ast->binary->right->lit->string_val);
         write_fmt("\",%d)", (int) escaped_strlen(ast->binary->right->lit->string_val));
         break;
     default:
@@ -376,20 +502,20 @@ void emit_dot_op(Scope *scope, Ast *ast) {
     Type *t = ast->dot->object->var_type;
 
     if (ast->dot->object->type == AST_LITERAL && ast->dot->object->lit->lit_type == ENUM_LIT) {
-        // TODO this should probably be a tmpvar
-        char *s = t->resolved->en.member_names[ast->dot->object->lit->enum_val.enum_index];
-        write_fmt("init_string(\"");
-        print_quoted_string(output, s);
-        write_fmt("\", %d)", (int)strlen(s));
+        emit_string_literal(t->resolved->en.member_names[ast->dot->object->lit->enum_val.enum_index]);
         return;
     }
 
     if (t->resolved->comp == STATIC_ARRAY) {
         if (!strcmp(ast->dot->member_name, "length")) {
-            write_fmt("%ld", t->resolved->array.length);
+            write_int(t->resolved->array.length);
         } else if (!strcmp(ast->dot->member_name, "data")) {
             compile(scope, ast->dot->object);
         }
+    } else if (is_string(t) && !strcmp(ast->dot->member_name, "bytes")) {
+        write_lit("string_bytes(");
+        emit_string_ref(scope, ast->dot->object);
+        write_lit(")");
     } else {
         compile(scope, ast->dot->object);
         if (t->resolved->comp == REF) {
@@ -403,15 +529,15 @@ void emit_dot_op(Scope *scope, Ast *ast) {
 void emit_uop(Scope *scope, Ast *ast) {
     switch (ast->unary->op) {
     case OP_NOT:
-        write_fmt("!"); break;
+        write_lit("!"); break;
     case OP_REF:
-        write_fmt("&"); break;
+        write_lit("&"); break;
     case OP_DEREF:
-        write_fmt("*"); break;
+        write_lit("*"); break;
     case OP_MINUS:
-        write_fmt("-"); break;
+        write_lit("-"); break;
     case OP_PLUS:
-        write_fmt("+"); break;
+        write_lit("+"); break;
     default:
         error(ast->line, ast->file, "Unkown unary operator '%s' (%s).",
             op_to_str(ast->unary->op), ast->unary->op);
@@ -426,28 +552,28 @@ void emit_assignment(Scope *scope, Ast *ast) {
     Type *lt = l->var_type;
 
     if (lt->resolved->comp == STATIC_ARRAY) {
-        write_fmt("{\n");
+        write_lit("{\n");
         change_indent(1);
         indent();
 
         emit_type(lt);
-        write_fmt("l = ");
+        write_lit("l = ");
         compile_static_array(scope, l);
-        write_fmt(";\n");
+        write_lit(";\n");
         indent();
 
         emit_type(lt);
-        write_fmt("r = ");
+        write_lit("r = ");
         compile_static_array(scope, r);
-        write_fmt(";\n");
+        write_lit(";\n");
         indent();
 
         emit_static_array_copy(scope, lt, "l", "r");
-        write_fmt(";\n");
+        write_lit(";\n");
 
         change_indent(-1);
         indent();
-        write_fmt("}");
+        write_lit("}");
         return;
     }
 
@@ -471,20 +597,20 @@ void emit_assignment(Scope *scope, Ast *ast) {
             } else {
                 compile(scope, r);
             }
-            write_fmt(";\n");
+            write_lit(";\n");
             indent();
-            write_fmt("SWAP(");
+            write_lit("SWAP(");
 
             if (l->type == AST_DOT || l->type == AST_INDEX || l->type == AST_UOP) {
                 compile(scope, l);
             } else {
-                write_fmt("_vs_%d", l->ident->var->id);
+                write_var_name(l->ident->var->id);
             }
             write_fmt(",_tmp%d)", temp->id);
         }
     } else {
         compile(scope, l);
-        write_fmt(" = ");
+        write_lit(" = ");
         if (lt->resolved->comp == ARRAY) {
             compile_unspecified_array(scope, r);
         } else if (lt->resolved->comp == STATIC_ARRAY) {
@@ -506,30 +632,36 @@ void emit_binop(Scope *scope, Ast *ast) {
         emit_string_binop(scope, ast);
         return;
     } else if (ast->binary->op == OP_OR) {
-        write_fmt("(");
+        write_lit("(");
         compile(scope, ast->binary->left);
-        write_fmt(") || (");
+        write_lit(") || (");
         compile(scope, ast->binary->right);
-        write_fmt(")");
+        write_lit(")");
         return;
     } else if (ast->binary->op == OP_AND) {
-        write_fmt("(");
+        write_lit("(");
         compile(scope, ast->binary->left);
-        write_fmt(") && ("); // does this short-circuit?
+        write_lit(") && ("); // does this short-circuit?
         compile(scope, ast->binary->right);
-        write_fmt(")");
+        write_lit(")");
         return;
     }
-    write_fmt("(");
+    write_lit("(");
     compile(scope, ast->binary->left);
     write_fmt(" %s ", op_to_str(ast->binary->op));
     compile(scope, ast->binary->right);
-    write_fmt(")");
+    write_lit(")");
 }
 
 void emit_copy(Scope *scope, Ast *ast) {
     Type *t = ast->var_type;
 
+    if (ast->type == AST_IDENTIFIER && ast->ident->moved) {
+        ast->ident->var->moved = 1;
+        compile(scope, ast);
+        return;
+    }
+
     // TODO: should this bail out here, or just never be called?
     /*if (t->comp == FUNC || !is_dynamic(t)) {*/
     // TODO: is this good? are we missing places that owned references need to
@@ -540,13 +672,13 @@ void emit_copy(Scope *scope, Ast *ast) {
     }
 
     if (is_string(t)) {
-        write_fmt("copy_string(");
+        write_lit("copy_string(");
         compile(scope, ast);
-        write_fmt(")");
+        write_lit(")");
     } else if (t->resolved->comp == STRUCT) {
         write_fmt("_copy_%d(", t->id);
         compile(scope, ast);
-        write_fmt(")");
+        write_lit(")");
     /*} else if (t->comp == STATIC_ARRAY) {*/
         /*emit_static_array_copy(scope, ast->decl->var->type, dname, "_0");*/
     /*} else if (t->comp == ARRAY) {*/
@@ -563,46 +695,46 @@ void emit_type(Type *type) {
     case BASIC:
         switch (r->data->base) {
         case UINT_T:
-            write_fmt("u");
+            write_lit("u");
         case INT_T:
             write_fmt("int%d_t ", r->data->size * 8);
             break;
         case FLOAT_T:
             if (r->data->size == 4) { // TODO double-check these are always the right size
-                write_fmt("float ");
+                write_lit("float ");
             } else if (r->data->size == 8) {
-                write_fmt("double ");
+                write_lit("double ");
             } else {
                 error(-1, "internal", "Cannot compile floating-point type of size %d.", r->data->size);
             }
             break;
         case BOOL_T:
-            write_fmt("unsigned char ");
+            write_lit("unsigned char ");
             break;
         case STRING_T:
-            write_fmt("struct string_type ");
+            write_lit("struct string_type ");
             break;
         case VOID_T:
-            write_fmt("void ");
+            write_lit("void ");
             break;
         case BASEPTR_T:
-            write_fmt("ptr_type ");
+            write_lit("ptr_type ");
             break;
         }
         break;
     case FUNC:
-        write_fmt("fn_type ");
+        write_lit("fn_type ");
         break;
     case REF:
         emit_type(r->ref.inner);
-        write_fmt("*");
+        write_lit("*");
         break;
     case ARRAY:
-        write_fmt("struct array_type ");
+        write_lit("struct array_type ");
         break;
     case STATIC_ARRAY:
         emit_type(r->array.inner);
-        write_fmt("*");
+        write_lit("*");
         break;
     case STRUCT:
         write_fmt("struct _type_vs_%d ", type->id);
@@ -615,18 +747,48 @@ void emit_type(Type *type) {
     }
 }
 
+static int is_addressable(Ast *ast) {
+    switch (ast->type) {
+    case AST_IDENTIFIER:
+    case AST_INDEX:
+        return 1;
+    case AST_DOT:
+        return ast->dot->object->var_type->resolved->comp == REF || is_addressable(ast->dot->object);
+    case AST_UOP:
+        return ast->unary->op == OP_DEREF;
+    default:
+        return 0;
+    }
+}
+
+// A pointer to the string, which short strings need for their bytes to be
+// addressed (string_bytes) since those are kept in the struct. Values that
+// aren't in a variable go into a compound literal, alive to the end of the
+// enclosing block.
+void emit_string_ref(Scope *scope, Ast *ast) {
+    if (is_addressable(ast)) {
+        write_lit("&(");
+        compile(scope, ast);
+        write_lit(")");
+    } else {
+        write_lit("(struct string_type[]){");
+        compile(scope, ast);
+        write_lit("}");
+    }
+}
+
 void compile_unspecified_array(Scope *scope, Ast *ast) {
     if (is_string(ast->var_type)) {
-        write_fmt("string_as_array(");
-        compile(scope, ast);
-        write_fmt(")");
+        write_lit("string_as_array(");
+        emit_string_ref(scope, ast);
+        write_lit(")");
         return;
     }
     TypeComp c = ast->var_type->resolved->comp;
     if (c == ARRAY) {
         compile(scope, ast);
     } else if (c == STATIC_ARRAY) {
-        write_fmt("(struct array_type){.data=");
+        write_lit("(struct array_type){.data=");
         compile(scope, ast);
         write_fmt(",.length=%ld}", ast->var_type->resolved->array.length);
     } else {
@@ -638,9 +800,9 @@ void compile_static_array(Scope *scope, Ast *ast) {
     if (ast->var_type->resolved->comp == STATIC_ARRAY) {
         compile(scope, ast);
     } else if (ast->var_type->resolved->comp == ARRAY) {
-        write_fmt("(");
+        write_lit("(");
         compile(scope, ast);
-        write_fmt(").data");
+        write_lit(").data");
     } else {
         error(ast->line, ast->file, "Was expecting a static array here, man.");
     }
@@ -653,11 +815,11 @@ void emit_static_array_decl(Scope *scope, Ast *ast) {
     free(membername);
 
     if (ast->decl->init == NULL) {
-        write_fmt(" = {0}");
+        write_lit(" = {0}");
     } else if (ast->decl->init->type == AST_LITERAL) {
         assert(ast->decl->init->lit->lit_type == ARRAY_LIT);
 
-        write_fmt(" = {");
+        write_lit(" = {");
         ResolvedType *r = ast->decl->var->type->resolved;
         for (int i = 0; i < r->array.length; i++) {
             Ast *expr = ast->decl->init->lit->compound_val.member_exprs[i];
@@ -670,32 +832,31 @@ void emit_static_array_decl(Scope *scope, Ast *ast) {
                 compile(scope, expr);
             }
             if (i < r->array.length - 1) {
-                write_fmt(",");
+                write_lit(",");
             }
         }
-        write_fmt("}");
+        write_lit("}");
     } else {
-        write_fmt(";\n");
+        write_lit(";\n");
         indent();
-        write_fmt("{\n");
+        write_lit("{\n");
         change_indent(1);
         indent();
         emit_type(ast->decl->var->type);
-        write_fmt("_0 = ");
+        write_lit("_0 = ");
         compile_static_array(scope, ast->decl->init);
-        write_fmt(";\n");
+        write_lit(";\n");
         indent();
 
         char *dname = malloc(sizeof(char) * (snprintf(NULL, 0, "_vs_%d", ast->decl->var->id) + 1));
         sprintf(dname, "_vs_%d", ast->decl->var->id);
-        dname[strlen(ast->decl->var->name) + 5] = 0;
         emit_static_array_copy(scope, ast->decl->var->type, dname, "_0");
-        write_fmt(";\n");
+        write_lit(";\n");
         free(dname);
 
         change_indent(-1);
         indent();
-        write_fmt("}");
+        write_lit("}");
     }
     ast->decl->var->initialized = 1;
 }
@@ -708,30 +869,30 @@ void emit_decl(Scope *scope, Ast *ast) {
     }
     emit_type(t);
     TypeComp c = t->resolved->comp;
-    write_fmt("_vs_%d", ast->decl->var->id);
+    write_var_name(ast->decl->var->id);
     if (ast->decl->init == NULL) {
         if (c == BASIC) {
             int b = t->resolved->data->base;
             if (b == STRING_T) {
-                write_fmt(" = (struct string_type){0}");
+                write_lit(" = (struct string_type){0}");
                 ast->decl->var->initialized = 1;
-            } else if (b == INT_T || b == UINT_T || b == FLOAT_T) {
-                write_fmt(" = 0");
+            } else if (b == INT_T || b == UINT_T || b == FLOAT_T || b == BOOL_T) {
+                write_lit(" = 0");
             } else if (b == BASEPTR_T) {
-                write_fmt(" = NULL");
+                write_lit(" = NULL");
             }
         } else if (c == STRUCT) {
-            write_fmt(";\n");
+            write_lit(";\n");
             indent();
             write_fmt("_init_%d(&_vs_%d)", t->id, ast->decl->var->id);
             ast->decl->var->initialized = 1;
         } else if (c == REF)  {
-            write_fmt(" = NULL");
+            write_lit(" = NULL");
         } else if (c == ARRAY) {
-            write_fmt(" = {0}");
+            write_lit(" = {0}");
         }
     } else {
-        write_fmt(" = ");
+        write_lit(" = ");
         if (c == ARRAY) {
             compile_unspecified_array(scope, ast->decl->init);
         } else if (is_any(t) && !is_any(ast->decl->init->var_type)) {
@@ -752,6 +913,7 @@ void emit_func_decl(Scope *scope, Ast *fn) {
         // polymorph not being used
         return;
     }
+    trace_begin("emit", fn_decl_name(fn->fn_decl), fn->file);
     if (fn->fn_decl->polymorph_of) {
         write_fmt("/* polymorph %s of %s */\n", type_to_string(fn->fn_decl->var->type), fn->fn_decl->polymorph_of->var->name);
     } else {
@@ -767,20 +929,22 @@ void emit_func_decl(Scope *scope, Ast *fn) {
     int nargs = array_len(args);
     for (int i = 0; i < nargs; i++) {
         if (i > 0) {
-            write_fmt(",");
+            write_lit(",");
         }
         if (r->fn.variadic && i == (nargs - 1)) {
-            write_fmt("struct array_type ");
+            write_lit("struct array_type ");
         } else {
             emit_type(args[i]->type);
         }
-        write_fmt("_vs_%d", args[i]->id);
+        write_var_name(args[i]->id);
     }
-    write_fmt(") ");
+    write_lit(") ");
 
+    find_moves(fn->fn_decl);
     emit_scope_start(fn->fn_decl->scope);
     compile_block(fn->fn_decl->scope, fn->fn_decl->body);
     emit_scope_end(fn->fn_decl->scope);
+    trace_end();
 }
 
 void emit_structmember(Scope *scope, char *name, Type *st) {
@@ -794,7 +958,7 @@ void emit_structmember(Scope *scope, char *name, Type *st) {
         write_fmt("[%ld]", length);
     } else {
         emit_type(st);
-        write_fmt("%s", name);
+        write_str(name);
     }
 }
 
@@ -808,7 +972,7 @@ void emit_static_array_copy(Scope *scope, Type *t, char *dest, char *src) {
     }
 
     int d = _static_array_copy_depth++;
-    write_fmt("{\n");
+    write_lit("{\n");
     change_indent(1);
     indent();
 
@@ -828,11 +992,9 @@ void emit_static_array_copy(Scope *scope, Type *t, char *dest, char *src) {
 
         char *dname = malloc(sizeof(char) * (depth_len + 2));
         sprintf(dname, "d%d", d);
-        dname[depth_len+2] = 0;
 
         char *sname = malloc(sizeof(char) * (depth_len + 2));
         sprintf(sname, "s%d", d);
-        sname[depth_len+2] = 0;
 
         write_fmt("%s = %s[i], %s = %s[i];\n", dname, dest, sname, src);
         emit_static_array_copy(scope, t->resolved->array.inner, dname, sname);
@@ -846,15 +1008,15 @@ void emit_static_array_copy(Scope *scope, Type *t, char *dest, char *src) {
     } else {
         write_fmt("%s[i] = %s[i]", dest, src);
     }
-    write_fmt(";\n"); // TODO move this?
+    write_lit(";\n"); // TODO move this?
 
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
     _static_array_copy_depth--;
 }
 
@@ -870,45 +1032,48 @@ void emit_struct_decl(Scope *scope, Type *st) {
     array_push(struct_types, st);
 
     emit_type(st);
-    write_fmt("{\n");
+    write_lit("{\n");
 
     change_indent(1);
     for (int i = 0; i < array_len(r->st.member_names); i++) {
         indent();
         emit_structmember(scope, r->st.member_names[i], r->st.member_types[i]);
-        write_fmt(";\n");
+        write_lit(";\n");
     }
 
     change_indent(-1);
     indent();
-    write_fmt("};\n");
+    write_lit("};\n");
 
+    if (split_units) {
+        write_lit("static ");
+    }
     emit_type(st);
     write_fmt("*_init_%d(", st->id);
 
     emit_type(st);
-    write_fmt("*x) {\n");
+    write_lit("*x) {\n");
 
     change_indent(1);
     indent();
 
-    write_fmt("if (x == NULL) {\n");
+    write_lit("if (x == NULL) {\n");
 
     change_indent(1);
     indent();
 
-    write_fmt("x = malloc(sizeof(");
+    write_lit("x = malloc(sizeof(");
     emit_type(st);
-    write_fmt("));\n");
+    write_lit("));\n");
 
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 
     indent();
-    write_fmt("memset(x, 0, sizeof(");
+    write_lit("memset(x, 0, sizeof(");
     emit_type(st);
-    write_fmt("));\n");
+    write_lit("));\n");
 
     /*for (int i = 0; i < r->st.nmembers; i++) {*/
         /*Type *t = r->st.member_types[i];*/
@@ -916,21 +1081,24 @@ void emit_struct_decl(Scope *scope, Type *st) {
             /*indent();*/
             /*write_fmt("x->%s = calloc(sizeof(", r->st.member_names[i]);*/
             /*emit_type(t->ref.inner);*/
-            /*write_fmt("), 1);\n");*/
+            /*write_lit("), 1);\n");*/
         /*}*/
     /*}*/
 
     indent();
-    write_fmt("return x;\n");
+    write_lit("return x;\n");
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 
+    if (split_units) {
+        write_lit("static ");
+    }
     emit_type(st);
     write_fmt("_copy_%d(", st->id);
 
     emit_type(st);
-    write_fmt("x) {\n");
+    write_lit("x) {\n");
 
     change_indent(1);
     for (int i = 0; i < array_len(r->st.member_names); i++) {
@@ -943,7 +1111,7 @@ void emit_struct_decl(Scope *scope, Type *st) {
             char *member = malloc(sizeof(char) * (strlen(member_name) + 3));
             sprintf(member, "x.%s", member_name);
             emit_static_array_copy(scope, member_type, member, member);
-            write_fmt(";\n");
+            write_lit(";\n");
             free(member);
         } else if (is_string(member_type)) {
             indent();
@@ -965,23 +1133,23 @@ void emit_struct_decl(Scope *scope, Type *st) {
             indent();
             write_fmt("x.%s = malloc(sizeof(", member_name);
             emit_type(r->st.member_types[i]);
-            write_fmt("));\n");
+            write_lit("));\n");
             indent();
             write_fmt("*x.%s = tmp%d;\n", member_name, i);
         }
     }
     indent();
-    write_fmt("return x;\n");
+    write_lit("return x;\n");
 
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 }
 
 void compile_ref(Scope *scope, Ast *ast) {
     assert(is_lvalue(ast));
 
-    write_fmt("&");
+    write_lit("&");
     compile(scope, ast);
 }
 
@@ -1006,7 +1174,7 @@ void compile_block(Scope *scope, AstBlock *block) {
             stmt->type != AST_FOR && stmt->type != AST_BLOCK &&
             stmt->type != AST_ANON_SCOPE && stmt->type != AST_IMPORT &&
             stmt->type != AST_TYPE_DECL && stmt->type != AST_ENUM_DECL) {
-            write_fmt(";\n");
+            write_lit(";\n");
         }
     }
 }
@@ -1046,20 +1214,20 @@ void compile_fn_call(Scope *scope, Ast *ast) {
     Type **argtypes = r->fn.args;
 
     if (needs_wrapper) {
-        write_fmt("((");
+        write_lit("((");
         emit_type(r->fn.ret[0]);
-        write_fmt("(*)(");
+        write_lit("(*)(");
         if (array_len(r->fn.args) == 0) {
-            write_fmt("void");
+            write_lit("void");
         } else {
             for (int i = 0; i < array_len(argtypes); i++) {
                 if (i > 0) {
-                    write_fmt(",");
+                    write_lit(",");
                 }
                 emit_type(argtypes[i]);
             }
         }
-        write_fmt("))(");
+        write_lit("))(");
     }
 
     if (needs_temp_var(ast->call->fn)) {
@@ -1069,16 +1237,16 @@ void compile_fn_call(Scope *scope, Ast *ast) {
     }
 
     if (needs_wrapper) {
-        write_fmt("))");
+        write_lit("))");
     }
 
-    write_fmt("(");
+    write_lit("(");
 
     TempVar *vt = ast->call->variadic_tempvar;
     int type_index = 0;
     for (int i = 0; i < array_len(ast->call->args); i++) {
         if (i > 0) {
-            write_fmt(",");
+            write_lit(",");
         }
 
         if (!r->fn.variadic || i < array_len(argtypes) - 1) {
@@ -1097,7 +1265,7 @@ void compile_fn_call(Scope *scope, Ast *ast) {
                 }
             } else {
                 if (i == array_len(r->fn.args) - 1) {
-                    write_fmt("(");
+                    write_lit("(");
                 }
                 if (i >= array_len(r->fn.args) - 1) {
                     write_fmt("_tmp%d[%d] = ", vt->var->id, i - (array_len(r->fn.args) - 1));
@@ -1120,17 +1288,17 @@ void compile_fn_call(Scope *scope, Ast *ast) {
 
     if (r->fn.variadic && !ast->call->has_spread) {
         if (array_len(ast->call->args) - array_len(r->fn.args) < 0) {
-            write_fmt(", (struct array_type){0, NULL}");
+            write_lit(", (struct array_type){0, NULL}");
         } else if (array_len(ast->call->args) > array_len(r->fn.args) - 1) {
             write_fmt(", (struct array_type){%ld, _tmp%d})",
                 vt->var->type->resolved->array.length, vt->var->id); // this assumes we have set vt correctly
         }
     }
-    write_fmt(")");
+    write_lit(")");
 }
 
 void emit_scope_start(Scope *scope) {
-    write_fmt("{\n");
+    write_lit("{\n");
     change_indent(1);
     for (int i = 0; i < array_len(scope->temp_vars); i++) {
         Type *t = scope->temp_vars[i]->var->type;
@@ -1142,23 +1310,23 @@ void emit_scope_start(Scope *scope) {
             emit_type(t);
             write_fmt("_tmp%d", scope->temp_vars[i]->var->id);
             if (t->resolved->comp == STRUCT || is_string(t)) {
-                write_fmt(" = {0}");
+                write_lit(" = {0}");
             }
         }
-        write_fmt(";\n");
+        write_lit(";\n");
     }
 }
 
 void open_block() {
     indent();
-    write_fmt("{\n");
+    write_lit("{\n");
     change_indent(1);
 }
 
 void close_block() {
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 }
 
 void emit_free_struct(Scope *scope, char *name, Type *st, int is_ref) {
@@ -1174,7 +1342,7 @@ void emit_free_struct(Scope *scope, char *name, Type *st, int is_ref) {
 
         if (is_string(member_type)) {
             indent();
-            write_fmt("free(%s.bytes);\n", memname);
+            write_fmt("free_string(%s);\n", memname);
         } else if (member_res->comp == STRUCT) {
             int ref = (member_res->comp == REF || (member_res->comp == BASIC && member_res->data->base == BASEPTR_T));
             emit_free_struct(scope, memname, r->st.member_types[i], ref);
@@ -1198,7 +1366,6 @@ void emit_free_struct(Scope *scope, char *name, Type *st, int is_ref) {
                 write_fmt("_vs_%d = _0[i];\n", v->id);
 
                 emit_free(scope, v);
-                free(v);
 
                 close_block();
                 close_block();
@@ -1212,7 +1379,7 @@ void emit_free_struct(Scope *scope, char *name, Type *st, int is_ref) {
                 emit_free_struct(scope, memname, inner, 1);
             } else if (is_string(inner)) { // TODO should this behave this way?
                 indent();
-                write_fmt("free(%s->bytes);\n", memname);
+                write_fmt("free_string(*%s);\n", memname);
             }
 
             indent();
@@ -1235,14 +1402,14 @@ void emit_free(Scope *scope, Var *var) {
                 emit_free_struct(scope, name, inner, 1);
                 free(name);
                 indent();
-                write_fmt("free(");
+                write_lit("free(");
                 write_fmt(name_fmt, var->id);
-                write_fmt(");\n");
+                write_lit(");\n");
             } else if (is_string(inner)) { // TODO should this behave this way?
                 indent();
-                write_fmt("free(");
+                write_lit("free_string(*");
                 write_fmt(name_fmt, var->id);
-                write_fmt("->bytes);\n");
+                write_lit(");\n");
             }
         }
     } else if (r->comp == STATIC_ARRAY) {
@@ -1251,9 +1418,9 @@ void emit_free(Scope *scope, Var *var) {
 
             indent();
             emit_type(r->array.inner);
-            write_fmt("*_0 = ");
+            write_lit("*_0 = ");
             write_fmt(name_fmt, var->id);
-            write_fmt(";\n");
+            write_lit(";\n");
 
             indent();
             write_fmt("for (int i = 0; i < %ld; i++) {\n", r->array.length);
@@ -1267,7 +1434,6 @@ void emit_free(Scope *scope, Var *var) {
             write_fmt("_vs_%d = _0[i];\n", v->id);
 
             emit_free(scope, v);
-            free(v);
 
             close_block();
             close_block();
@@ -1279,14 +1445,14 @@ void emit_free(Scope *scope, Var *var) {
 
                 indent();
                 emit_type(r->array.inner);
-                write_fmt("*_0 = ");
+                write_lit("*_0 = ");
                 write_fmt(name_fmt, var->id);
-                write_fmt(".data;\n");
+                write_lit(".data;\n");
 
                 indent();
-                write_fmt("for (int i = 0; i < ");
+                write_lit("for (int i = 0; i < ");
                 write_fmt(name_fmt, var->id);
-                write_fmt(".length; i++) {\n");
+                write_lit(".length; i++) {\n");
 
                 change_indent(1);
                 indent();
@@ -1297,14 +1463,13 @@ void emit_free(Scope *scope, Var *var) {
                 write_fmt("_vs_%d = _0[i];\n", v->id);
 
                 emit_free(scope, v);
-                free(v);
 
                 close_block();
                 close_block();
             }
-            write_fmt("free(");
+            write_lit("free(");
             write_fmt(name_fmt, var->id);
-            write_fmt(".data);\n");
+            write_lit(".data);\n");
         }
     } else if (r->comp == STRUCT) {
         char *name;
@@ -1315,9 +1480,9 @@ void emit_free(Scope *scope, Var *var) {
     } else if (r->comp == BASIC) {
         if (r->data->base == STRING_T) {
             indent();
-            write_fmt("free(");
+            write_lit("free_string(");
             write_fmt(name_fmt, var->id);
-            write_fmt(".bytes);\n");
+            write_lit(");\n");
         }
     }
 }
@@ -1325,7 +1490,7 @@ void emit_free(Scope *scope, Var *var) {
 void emit_free_locals_except_return(Scope *scope, Var *returned) {
     for (int i = array_len(scope->vars)-1; i >= 0; --i) {
         Var *v = scope->vars[i];
-        if (v->proxy ||
+        if (v->proxy || v->moved ||
            (returned && (v == returned || v->id == returned->id))) {
             continue;
         }
@@ -1343,7 +1508,7 @@ void emit_free_locals_except_return(Scope *scope, Var *returned) {
 void emit_free_locals(Scope *scope) {
     for (int i = array_len(scope->vars)-1; i >= 0; --i) {
         Var *v = scope->vars[i];
-        if (v->proxy) {
+        if (v->proxy || v->moved) {
             continue;
         }
         emit_free(scope, v);
@@ -1368,7 +1533,7 @@ void emit_init_scope_end(Scope *scope) {
     emit_free_temp(scope);
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 }
 
 void emit_scope_end(Scope *scope) {
@@ -1378,7 +1543,7 @@ void emit_scope_end(Scope *scope) {
     }
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 }
 
 void emit_deferred(Scope *scope) {
@@ -1390,67 +1555,90 @@ void emit_deferred(Scope *scope) {
             write_fmt("_tmp%d = ", v->id);
         }
         compile(scope, d);
-        write_fmt(";\n");
+        write_lit(";\n");
     }
 }
 
-void emit_extern_fn_decl(Scope *scope, Var *v) {
-    write_fmt("extern ");
+static void extern_fn_decl(Var *v, int ext) {
+    write_lit("extern ");
 
     ResolvedType *r = v->type->resolved;
     emit_type(r->fn.ret[0]);
     write_fmt("%s(", v->name);
     for (int i = 0; i < array_len(r->fn.args); i++) {
         if (i > 0) {
-            write_fmt(",");
+            write_lit(",");
         }
         emit_type(r->fn.args[i]);
     }
-    write_fmt(");\n");
+    write_lit(");\n");
 
+    if (ext) {
+        write_lit("extern ");
+    }
     emit_type(r->fn.ret[0]);
     write_fmt("(*_vs_%s)(", v->name);
 
     for (int i = 0; i < array_len(r->fn.args); i++) {
         if (i > 0) {
-            write_fmt(",");
+            write_lit(",");
         }
         emit_type(r->fn.args[i]);
     }
-    write_fmt(") = %s;\n", v->name);
+    if (ext) {
+        write_lit(");\n");
+    } else {
+        write_fmt(") = %s;\n", v->name);
+    }
 }
 
-void emit_var_decl(Scope *scope, Var *v) {
+static void var_decl(Var *v, int ext) {
     if (v->ext) {
-        emit_extern_fn_decl(scope, v);
+        extern_fn_decl(v, ext);
         return;
     }
 
+    if (ext) {
+        write_lit("extern ");
+    }
     ResolvedType *r = v->type->resolved;
     if (r->comp == FUNC) {
         emit_type(r->fn.ret[0]);
-        write_fmt("(*");
+        write_lit("(*");
     } else if (r->comp == STATIC_ARRAY) {
         emit_type(r->array.inner);
-        write_fmt("_vs_%d[%ld] = {0};\n", v->id, r->array.length);
+        if (ext) {
+            write_fmt("_vs_%d[%ld];\n", v->id, r->array.length);
+        } else {
+            write_fmt("_vs_%d[%ld] = {0};\n", v->id, r->array.length);
+        }
         return;
     } else {
         emit_type(v->type);
     }
 
-    write_fmt("_vs_%d", v->id);
+    write_var_name(v->id);
     if (r->comp == FUNC) {
-        write_fmt(")(");
+        write_lit(")(");
         for (int i = 0; i < array_len(r->fn.args); i++) {
             if (i > 0) {
-                write_fmt(",");
+                write_lit(",");
             }
             emit_type(r->fn.args[i]);
             write_fmt("a%d", i);
         }
-        write_fmt(")");
+        write_lit(")");
     }
-    write_fmt(";\n");
+    write_lit(";\n");
+}
+
+void emit_var_decl(Scope *scope, Var *v) {
+    var_decl(v, 0);
+}
+
+// Declares a global defined in another unit.
+void emit_extern_var_decl(Scope *scope, Var *v) {
+    var_decl(v, 1);
 }
 
 void emit_forward_decl(Scope *scope, AstFnDecl *decl) {
@@ -1465,7 +1653,7 @@ void emit_forward_decl(Scope *scope, AstFnDecl *decl) {
         write_fmt("/* %s */\n", decl->var->name);
     }
     if (decl->var->ext) {
-        write_fmt("extern ");
+        write_lit("extern ");
     }
     assert(r->comp == FUNC);
     emit_type(r->fn.ret[0]);
@@ -1474,16 +1662,16 @@ void emit_forward_decl(Scope *scope, AstFnDecl *decl) {
 
     for (int i = 0; i < array_len(r->fn.args); i++) {
         if (i > 0) {
-            write_fmt(",");
+            write_lit(",");
         }
         if (r->fn.variadic && i == (array_len(r->fn.args) - 1)) {
-            write_fmt("struct array_type ");
+            write_lit("struct array_type ");
         } else {
             emit_type(r->fn.args[i]);
         }
         write_fmt("a%d", i);
     }
-    write_fmt(");\n");
+    write_lit(");\n");
 }
 
 void emit_slice(Scope *scope, Ast *ast) {
@@ -1491,29 +1679,37 @@ void emit_slice(Scope *scope, Ast *ast) {
     ResolvedType *r = obj_type->resolved;
 
     if (is_string(obj_type)) {
-        write_fmt("string_slice(");
-        compile(scope, ast->slice->object);
-        write_fmt(",");
+        if (ast->slice->borrowed) {
+            write_lit("string_view(");
+        } else {
+            write_lit("string_slice(");
+        }
+        if (needs_temp_var(ast->slice->object)) {
+            emit_temp_var(scope, ast->slice->object, 0);
+        } else {
+            compile(scope, ast->slice->object);
+        }
+        write_lit(",");
         if (ast->slice->offset != NULL) {
             compile(scope, ast->slice->offset);
         } else {
-            write_fmt("0");
+            write_lit("0");
         }
-        write_fmt(",");
+        write_lit(",");
         if (ast->slice->length != NULL) {
             compile(scope, ast->slice->length);
         } else {
-            write_fmt("-1");
+            write_lit("-1");
         }
-        write_fmt(")");
+        write_lit(")");
         return;
     }
 
     if (r->comp == STATIC_ARRAY) {
-        write_fmt("(struct array_type){.data=");
+        write_lit("(struct array_type){.data=");
 
         if (ast->slice->offset != NULL) {
-            write_fmt("((char *)");
+            write_lit("((char *)");
         }
 
         if (needs_temp_var(ast->slice->object)) {
@@ -1523,46 +1719,46 @@ void emit_slice(Scope *scope, Ast *ast) {
         }
 
         if (ast->slice->offset != NULL) {
-            write_fmt(")+(");
+            write_lit(")+(");
             compile(scope, ast->slice->offset);
-            write_fmt("*sizeof(");
+            write_lit("*sizeof(");
             emit_type(r->array.inner);
-            write_fmt("))");
+            write_lit("))");
         }
 
-        write_fmt(",.length=");
+        write_lit(",.length=");
         if (ast->slice->length != NULL) {
             compile(scope, ast->slice->length);
         } else {
-            write_fmt("%ld", r->array.length);
+            write_int(r->array.length);
         }
 
         if (ast->slice->offset != NULL) {
-            write_fmt("-");
+            write_lit("-");
             compile(scope, ast->slice->offset);
         }
-        write_fmt("}");
+        write_lit("}");
     } else { // ARRAY
-        write_fmt("array_slice(");
+        write_lit("array_slice(");
 
         compile_unspecified_array(scope, ast->slice->object);
 
-        write_fmt(",");
+        write_lit(",");
         if (ast->slice->offset != NULL) {
             compile(scope, ast->slice->offset);
-            write_fmt(",sizeof(");
+            write_lit(",sizeof(");
             emit_type(r->array.inner);
-            write_fmt("),");
+            write_lit("),");
         } else {
-            write_fmt("0,0,");
+            write_lit("0,0,");
         }
 
         if (ast->slice->length != NULL) {
             compile(scope, ast->slice->length);
         } else {
-            write_fmt("-1");
+            write_lit("-1");
         }
-        write_fmt(")");
+        write_lit(")");
     }
 }
 
@@ -1570,15 +1766,17 @@ void emit_return(Scope *scope, Ast *ast) {
     Var *ret = NULL;
     if (ast->ret->expr != NULL) {
         emit_type(ast->ret->expr->var_type);
-        write_fmt("_ret = ");
-        // TODO: if this doesn't actually need to be copied, we have to make
-        // sure it isn't cleaned up on return
-        if (is_lvalue(ast->ret->expr)) {
+        write_lit("_ret = ");
+        // a moved local is left out of the frees below; var->moved isn't set,
+        // as code after this return (in another branch) still owns it
+        if (ast->ret->expr->type == AST_IDENTIFIER && ast->ret->expr->ident->moved) {
+            compile(scope, ast->ret->expr);
+        } else if (is_lvalue(ast->ret->expr)) {
             emit_copy(scope, ast->ret->expr);
         } else {
             compile(scope, ast->ret->expr);
         }
-        write_fmt(";");
+        write_lit(";");
 
         // TODO: check the type, only do this for owned?
         if (ast->ret->expr->type == AST_IDENTIFIER) {
@@ -1590,7 +1788,7 @@ void emit_return(Scope *scope, Ast *ast) {
             ret = find_temp_var(scope, ast->ret->expr);
         }
     }
-    write_fmt("\n");
+    write_lit("\n");
     emit_deferred(scope);
 
     // emit parent defers
@@ -1610,27 +1808,27 @@ void emit_return(Scope *scope, Ast *ast) {
                 write_fmt("_tmp%d = ", v->id);
             }
             compile(s, d);
-            write_fmt(";\n");
+            write_lit(";\n");
         }
         s = s->parent;
     }
 
     indent();
-    write_fmt("return");
+    write_lit("return");
     if (ast->ret->expr != NULL) {
-        write_fmt(" _ret");
+        write_lit(" _ret");
     }
 }
 
 void emit_for_loop(Scope *scope, Ast *ast) {
     // TODO: loop depth should change iter var name?
-    write_fmt("{\n");
+    write_lit("{\n");
     change_indent(1);
     indent();
 
-    write_fmt("struct array_type _iter = ");
+    write_lit("struct array_type _iter = ");
     compile_unspecified_array(scope, ast->for_loop->iterable);
-    write_fmt(";\n");
+    write_lit(";\n");
 
     if (ast->for_loop->index != NULL) {
         indent();
@@ -1639,7 +1837,7 @@ void emit_for_loop(Scope *scope, Ast *ast) {
     }
 
     indent();
-    write_fmt("for (long _i = 0; _i < _iter.length; _i++) {\n");
+    write_lit("for (long _i = 0; _i < _iter.length; _i++) {\n");
 
     change_indent(1);
     indent();
@@ -1647,22 +1845,24 @@ void emit_for_loop(Scope *scope, Ast *ast) {
     if (ast->for_loop->by_reference) {
         emit_type(ast->for_loop->itervar->type);
         write_fmt("_vs_%d = ", ast->for_loop->itervar->id);
-        write_fmt("&");
-        write_fmt("((");
+        write_lit("&");
+        write_lit("((");
         emit_type(ast->for_loop->itervar->type);
-        write_fmt(")_iter.data)[_i];\n");
+        write_lit(")_iter.data)[_i];\n");
     } else {
         Type *t = ast->for_loop->itervar->type;
         emit_type(t);
         write_fmt("_vs_%d = ", ast->for_loop->itervar->id);
-        if (is_string(t)) {
-            write_fmt("copy_string");
+        if (ast->for_loop->borrowed) {
+            ast->for_loop->itervar->moved = 1;
+        } else if (is_string(t)) {
+            write_lit("copy_string");
         } else if (t->resolved->comp == STRUCT && is_dynamic(t)) {
             write_fmt("_copy_%d", t->id);
         }
-        write_fmt("(((");
+        write_lit("(((");
         emit_type(t);
-        write_fmt("*)_iter.data)[_i]);\n");
+        write_lit("*)_iter.data)[_i]);\n");
     }
 
     if (ast->for_loop->index != NULL) {
@@ -1670,7 +1870,7 @@ void emit_for_loop(Scope *scope, Ast *ast) {
         emit_type(ast->for_loop->index->type);
         write_fmt("_vs_%d = (", ast->for_loop->index->id);
         emit_type(ast->for_loop->index->type);
-        write_fmt(")_i;\n");
+        write_lit(")_i;\n");
     }
 
     indent();
@@ -1681,11 +1881,11 @@ void emit_for_loop(Scope *scope, Ast *ast) {
 
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 
     change_indent(-1);
     indent();
-    write_fmt("}\n");
+    write_lit("}\n");
 }
 
 void emit_integer_literal(Scope *scope, Ast *ast) {
@@ -1696,15 +1896,15 @@ void emit_integer_literal(Scope *scope, Ast *ast) {
     switch (res->data->size) {
         case 8:
             if (res->data->base == UINT_T) {
-                write_fmt("U");
+                write_lit("U");
             }
-            write_fmt("LL");
+            write_lit("LL");
             break;
         case 4:
             if (res->data->base == UINT_T) {
-                write_fmt("U");
+                write_lit("U");
             }
-            write_fmt("L");
+            write_lit("L");
             break;
         default:
             break;
@@ -1714,7 +1914,7 @@ void emit_integer_literal(Scope *scope, Ast *ast) {
 void emit_struct_literal(Scope *scope, Ast *ast) {
     write_fmt("(struct _type_vs_%d){", ast->var_type->id);
     if (array_len(ast->lit->compound_val.member_exprs) == 0) {
-        write_fmt("0");
+        write_lit("0");
     } else {
         StructType st = ast->var_type->resolved->st;
         for (int i = 0; i < array_len(ast->lit->compound_val.member_exprs); i++) {
@@ -1730,18 +1930,18 @@ void emit_struct_literal(Scope *scope, Ast *ast) {
             }
 
             if (i != array_len(st.member_names) - 1) {
-                write_fmt(", ");
+                write_lit(", ");
             }
         }
     }
-    write_fmt("}");
+    write_lit("}");
 }
 
 void emit_array_literal(Scope *scope, Ast *ast) {
     TempVar *tmp = ast->lit->compound_val.array_tempvar;
     long n = array_len(ast->lit->compound_val.member_exprs);
 
-    write_fmt("(");
+    write_lit("(");
     for (int i = 0; i < n; i++) {
         Ast *expr = ast->lit->compound_val.member_exprs[i];
         write_fmt("_tmp%d[%d] = ", tmp->var->id, i);
@@ -1754,7 +1954,7 @@ void emit_array_literal(Scope *scope, Ast *ast) {
             compile(scope, expr);
         }
 
-        write_fmt(",");
+        write_lit(",");
     }
     if (ast->var_type->resolved->comp == STATIC_ARRAY) {
         write_fmt("_tmp%d)", tmp->var->id);
@@ -1775,12 +1975,10 @@ void emit_literal(Scope *scope, Ast *ast) {
         write_fmt("'%c'", (unsigned char)ast->lit->int_val);
         break;
     case BOOL:
-        write_fmt("%d", (unsigned char)ast->lit->int_val);
+        write_int((unsigned char)ast->lit->int_val);
         break;
     case STRING:
-        write_fmt("init_string(\"");
-        print_quoted_string(output, ast->lit->string_val);
-        write_fmt("\", %d)", (int)strlen(ast->lit->string_val));
+        emit_string_literal(ast->lit->string_val);
         break;
     case STRUCT_LIT:
         emit_struct_literal(scope, ast);
@@ -1789,7 +1987,7 @@ void emit_literal(Scope *scope, Ast *ast) {
         emit_array_literal(scope, ast);
         break;
     case ENUM_LIT:
-        write_fmt("%ld", enum_type_val(ast->lit->enum_val.enum_type, ast->lit->enum_val.enum_index));
+        write_int(enum_type_val(ast->lit->enum_val.enum_type, ast->lit->enum_val.enum_index));
         break;
     case COMPOUND_LIT:
         error(ast->line, ast->file, "<internal> literal type should be determined at this point");
@@ -1799,11 +1997,11 @@ void emit_literal(Scope *scope, Ast *ast) {
 
 void emit_array_index(Scope *scope, Ast *ast) {
     Type *lt = ast->index->object->var_type;
-    write_fmt("(");
+    write_lit("(");
     if (lt->resolved->comp == ARRAY) {
-        write_fmt("(");
+        write_lit("(");
         emit_type(lt->resolved->array.inner);
-        write_fmt("*)");
+        write_lit("*)");
     }
 
     if (needs_temp_var(ast->index->object)) {
@@ -1812,7 +2010,7 @@ void emit_array_index(Scope *scope, Ast *ast) {
         compile_static_array(scope, ast->index->object);
     }
 
-    write_fmt(")[");
+    write_lit(")[");
 
     if (needs_temp_var(ast->index->index)) {
         emit_temp_var(scope, ast->index->index, 0);
@@ -1820,19 +2018,18 @@ void emit_array_index(Scope *scope, Ast *ast) {
         compile(scope, ast->index->index);
     }
 
-    write_fmt("]");
+    write_lit("]");
 }
 
 void emit_string_index(Scope *scope, Ast *ast) {
-    write_fmt("((uint8_t*)");
+    write_lit("((uint8_t*)string_bytes(");
     if (needs_temp_var(ast->index->object)) {
-        emit_temp_var(scope, ast->index->object, 0);
+        emit_temp_var(scope, ast->index->object, 1);
     } else {
-        // TODO: need string_as_array here?
-        compile(scope, ast->index->object);
+        emit_string_ref(scope, ast->index->object);
     }
 
-    write_fmt(".bytes)[");
+    write_lit("))[");
 
     if (needs_temp_var(ast->index->index)) {
         emit_temp_var(scope, ast->index->index, 0);
@@ -1840,7 +2037,7 @@ void emit_string_index(Scope *scope, Ast *ast) {
         compile(scope, ast->index->index);
     }
 
-    write_fmt("]");
+    write_lit("]");
 }
 
 void emit_index(Scope *scope, Ast *ast) {
@@ -1870,7 +2067,7 @@ void emit_parent_defers_recursively(Scope *scope) {
                 write_fmt("_tmp%d = ", v->id);
             }
             compile(s, d);
-            write_fmt(";\n");
+            write_lit(";\n");
         }
     }
 }
@@ -1882,22 +2079,22 @@ void emit_cast(Scope *scope, Ast *ast) {
     }
     ResolvedType *r = ast->cast->cast_type->resolved;
     if (r->comp == STRUCT) {
-        write_fmt("*");
+        write_lit("*");
     }
 
-    write_fmt("((");
+    write_lit("((");
     emit_type(ast->cast->cast_type);
     if (r->comp == STRUCT) {
-        write_fmt("*");
+        write_lit("*");
     }
 
-    write_fmt(")");
+    write_lit(")");
     if (r->comp == STRUCT) {
-        write_fmt("&");
+        write_lit("&");
     }
 
     compile(scope, ast->cast->object);
-    write_fmt(")");
+    write_lit(")");
 }
 
 void compile(Scope *scope, Ast *ast) {
@@ -1926,17 +2123,17 @@ void compile(Scope *scope, Ast *ast) {
 
         ResolvedType *r = ast->var_type->resolved;
         if (r->comp == ARRAY) {
-            write_fmt("(allocate_array(");
+            write_lit("(allocate_array(");
             compile(scope, ast->new->count);
-            write_fmt(",sizeof(");
+            write_lit(",sizeof(");
             emit_type(r->array.inner);
-            write_fmt(")))");
+            write_lit(")))");
         } else {
             assert(r->comp == REF);
             write_fmt("(_init_%d(NULL))", r->ref.inner->id);
         }
         if (tmp) {
-            write_fmt(")");
+            write_lit(")");
         }
         break;
     }
@@ -1951,7 +2148,7 @@ void compile(Scope *scope, Ast *ast) {
         if (ast->ident->var->ext) {
             write_fmt("_vs_%s", ast->ident->var->name);
         } else {
-            write_fmt("_vs_%d", ast->ident->var->id);
+            write_var_name(ast->ident->var->id);
         }
         break;
     case AST_RETURN:
@@ -1960,12 +2157,12 @@ void compile(Scope *scope, Ast *ast) {
     case AST_BREAK:
         emit_deferred(scope);
         emit_parent_defers_recursively(scope);
-        write_fmt("break");
+        write_lit("break");
         break;
     case AST_CONTINUE:
         emit_deferred(scope);
         emit_parent_defers_recursively(scope);
-        write_fmt("continue");
+        write_lit("continue");
         break;
     case AST_DECL:
         emit_decl(scope, ast);
@@ -1974,7 +2171,7 @@ void compile(Scope *scope, Ast *ast) {
     case AST_EXTERN_FUNC_DECL:
         break;
     case AST_ANON_FUNC_DECL:
-        write_fmt("_vs_%d", ast->fn_decl->var->id);
+        write_var_name(ast->fn_decl->var->id);
         break;
     case AST_CALL:
         compile_fn_call(scope, ast);
@@ -1994,18 +2191,18 @@ void compile(Scope *scope, Ast *ast) {
         emit_scope_start(ast->cond->initializer_scope);
         if (ast->cond->initializer) {
             compile(ast->cond->initializer_scope, ast->cond->initializer);
-            write_fmt(";\n");
+            write_lit(";\n");
             indent();
         }
-        write_fmt("if (");
+        write_lit("if (");
         compile(ast->cond->initializer_scope, ast->cond->condition);
-        write_fmt(") ");
+        write_lit(") ");
         emit_scope_start(ast->cond->if_scope);
         compile_block(ast->cond->if_scope, ast->cond->if_body);
         emit_scope_end(ast->cond->if_scope);
         if (ast->cond->else_body != NULL) {
             indent();
-            write_fmt("else ");
+            write_lit("else ");
             emit_scope_start(ast->cond->else_scope);
             compile_block(ast->cond->else_scope, ast->cond->else_body);
             emit_scope_end(ast->cond->else_scope);
@@ -2016,12 +2213,12 @@ void compile(Scope *scope, Ast *ast) {
         emit_scope_start(ast->while_loop->scope);
         if (ast->while_loop->initializer) {
             compile(ast->while_loop->scope, ast->while_loop->initializer);
-            write_fmt(";\n");
+            write_lit(";\n");
             indent();
         }
-        write_fmt("while (");
+        write_lit("while (");
         compile(ast->while_loop->inner_scope, ast->while_loop->condition);
-        write_fmt(") ");
+        write_lit(") ");
         emit_scope_start(ast->while_loop->inner_scope);
         compile_block(ast->while_loop->inner_scope, ast->while_loop->body);
         emit_scope_end(ast->while_loop->inner_scope);
@@ -5,13 +5,20 @@
 #include "var.h"
 #include "types.h"
 
+// strings up to this long are kept inline (see struct string_type in prelude.c)
+#define STRING_INLINE 15
+
 void indent();
 void change_indent(int n);
 void codegen_set_output(FILE *f);
+void codegen_flush();
+void codegen_begin_literals();
+void codegen_set_split(int split);
 int write_bytes(const char *b, ...);
 
 void emit_temp_var(Scope *scope, Ast *ast, int ref);
 
+void emit_string_literal(char *str);
 void emit_string_comparison(Scope *scope, Ast *ast);
 void emit_comparison(Scope *scope, Ast *ast);
 
@@ -26,11 +33,13 @@ void emit_copy(Scope *scope, Ast *ast);
 
 void emit_type(Type *type);
 void emit_typeinfo_decl(Scope *scope, Type *t);
+void emit_extern_typeinfo_decl(Scope *scope, Type *t);
 void emit_typeinfo_init(Scope *scope, Type *t);
 void emit_typeinfo_init_routine(Scope *root_scope, Type **builtins, Type **used_types);
 void emit_init_routine(Package **packages, Scope *root_scope, Ast *root, Var *main_var);
 void emit_entrypoint();
 
+void emit_string_ref(Scope *scope, Ast *ast);
 void compile_unspecified_array(Scope *scope, Ast *ast);
 void compile_static_array(Scope *scope, Ast *ast);
 void emit_static_array_decl(Scope *scope, Ast *ast);
@@ -40,6 +49,7 @@ void emit_decl(Scope *scope, Ast *ast);
 void emit_func_decl(Scope *scope, Ast *fn);
 void emit_struct_decl(Scope *scope, Type *st);
 void emit_var_decl(Scope *scope, Var *v);
+void emit_extern_var_decl(Scope *scope, Var *v);
 void emit_forward_decl(Scope *scope, AstFnDecl *decl);
 
 void emit_structmember(Scope *scope, char *name, Type *st);
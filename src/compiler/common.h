@@ -12,9 +12,21 @@ typedef struct Package {
     struct AstBlock *root;
     //struct Ast **statements;
     int semantics_checked;
+    int preloaded; // checked ahead of the program, imports not yet taken in
+    int *used_type_refs; // indexes of the used types it found or added
     char **top_level_comments;
 } Package;
 
+// Everything given an id while parsing a package on a worker thread, in
+// creation order. Ids show up in the generated code, so they are only
+// assigned once the package is adopted by the main thread (see load_package).
+typedef struct IdLog {
+    struct Ast **asts;
+    struct Var **vars;
+    struct Type **types;
+    struct Ast **anon_fns;
+} IdLog;
+
 typedef struct PkgFile {
     Package *package;
     char *name;
@@ -114,6 +126,9 @@ typedef struct Var {
     int length;
     int temp;
     int initialized;
+    // set by codegen once the value has been moved out (or, for a borrowed
+    // loop element, if it never owned it), so it isn't freed
+    unsigned char moved;
     unsigned char constant;
     unsigned char use;
     int ext;
@@ -130,6 +145,7 @@ typedef struct TempVar {
 typedef struct Polymorph {
     int               id;
     Type            **args;
+    unsigned int      args_hash;
     hashmap_t(TypeDef*)  defs;
     struct Scope     *scope;
     struct AstBlock  *body;
@@ -148,6 +164,7 @@ typedef struct Scope {
     struct Scope *parent;
     ScopeType type;
     struct Var **vars;
+    hashmap_t(struct Var*) var_index; // only built once vars gets large
     struct TempVar **temp_vars;
     hashmap_t(TypeDef*) types;
     Type **used_types;
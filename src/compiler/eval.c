@@ -78,8 +78,6 @@ Ast *eval_string_binop(Ast *ast) {
             char *s = malloc((strlen(l->string_val) + strlen(r->string_val) + 1) * (sizeof(char)));
             sprintf(s, "%s%s", l->string_val, r->string_val);
             s[strlen(l->string_val) + strlen(r->string_val)] = 0;
-            free(l->string_val); // hopefully nothing messed up by this
-            free(r->string_val);
             l->string_val = s;
             return left;
         }
@@ -4,19 +4,20 @@
 #include <stdlib.h>
 #include <string.h>
 
-// adapted from https://github.com/petewarden/c_hashmap
-// inspired by https://github.com/rxi/map
-
-typedef struct hashmap_element {
-	int   in_use;
-	char *key;
-	void *value;
-} hashmap_element;
+// Open addressing with SwissTable-style group probing: every slot has a
+// control byte (empty, deleted, or 7 bits of the key's hash), and lookups
+// compare a whole group of control bytes at once before touching any keys.
+// Values are stored inline, so pointers returned by get are only valid until
+// the next put on the same map.
 
 typedef struct hashmap {
-	int capacity;
+	int capacity; // 0 until the first put
 	int size;
-	hashmap_element *data;
+	int tombstones;
+	size_t vsize;
+	signed char *ctrl;
+	char **keys;
+	char *values;
 } hashmap;
 
 typedef struct iter_t {
@@ -0,0 +1,80 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "../arena/arena.h"
+
+#define INITIAL_SIZE (1024)
+
+typedef struct Entry {
+    uint32_t hash;
+    char *str;
+} Entry;
+
+static Entry *table = NULL;
+static uint32_t capacity = 0;
+static uint32_t count = 0;
+// packages may be parsed on worker threads (see -j)
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t hash_str(const char *s) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void grow() {
+    uint32_t old_cap = capacity;
+    Entry *old = table;
+    capacity = capacity ? capacity * 2 : INITIAL_SIZE;
+    table = calloc(capacity, sizeof(Entry));
+    for (uint32_t i = 0; i < old_cap; i++) {
+        if (old[i].str == NULL) {
+            continue;
+        }
+        uint32_t j = old[i].hash & (capacity - 1);
+        while (table[j].str != NULL) {
+            j = (j + 1) & (capacity - 1);
+        }
+        table[j] = old[i];
+    }
+    free(old);
+}
+
+static char *_intern(char *s, int copy) {
+    if (count * 2 >= capacity) {
+        grow();
+    }
+    uint32_t h = hash_str(s);
+    uint32_t i = h & (capacity - 1);
+    while (table[i].str != NULL) {
+        if (table[i].hash == h && (table[i].str == s || !strcmp(table[i].str, s))) {
+            return table[i].str;
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+    table[i].hash = h;
+    table[i].str = copy ? arena_strdup(s) : s;
+    count++;
+    return table[i].str;
+}
+
+char *intern(const char *s) {
+    pthread_mutex_lock(&lock);
+    char *out = _intern((char *)s, 1);
+    pthread_mutex_unlock(&lock);
+    return out;
+}
+
+char *intern_in_place(char *s) {
+    pthread_mutex_lock(&lock);
+    char *out = _intern(s, 0);
+    pthread_mutex_unlock(&lock);
+    return out;
+}
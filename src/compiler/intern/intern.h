@@ -0,0 +1,13 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+// Global string intern table. Every distinct name is stored exactly once, so
+// two interned strings are equal iff their pointers are equal.
+//
+// intern() copies the string into the arena the first time it is seen.
+// intern_in_place() adopts the given pointer instead, so it must outlive the
+// compiler (e.g. a slice of a source buffer).
+char *intern(const char *s);
+char *intern_in_place(char *s);
+
+#endif
@@ -0,0 +1,321 @@
+#include <stdlib.h>
+
+#include "array/array.h"
+#include "moves.h"
+#include "token.h"
+#include "types.h"
+
+// An owned local: a string or a struct holding one, declared in the function.
+typedef struct Owner {
+    Var *var;
+    int region;       // the block it's declared in
+    int pinned;       // its address is taken or a defer uses it, so it's never moved
+    Ast *last;        // its last use so far
+    int last_region;
+    int last_stmt;
+    int last_movable; // last is passed on as is, and always evaluated with its statement
+    int stmt_uses;    // how many times it's used in last_stmt
+} Owner;
+
+typedef struct Walk {
+    Owner *owners;
+    Ast **returns;     // identifiers returned as is
+    Var **assigned;    // identifiers assigned to, in order
+    int region;        // blocks are numbered; plain nested blocks share their parent's
+    int regions;
+    int stmt;
+    int stmts;
+    int conditional;   // > 0 where evaluation depends on a condition
+    int in_defer;
+    int side_effects;  // calls and writes that could change an array being iterated
+} Walk;
+
+static void walk(Walk *w, Ast *ast, int site);
+
+static int owns(Type *t) {
+    return is_string(t) || (t->resolved->comp == STRUCT && is_dynamic(t));
+}
+
+static Owner *find_owner(Walk *w, Var *v) {
+    for (int i = 0; i < array_len(w->owners); i++) {
+        if (w->owners[i].var->id == v->id) {
+            return &w->owners[i];
+        }
+    }
+    return NULL;
+}
+
+static void add_owner(Walk *w, Var *v) {
+    if (v->ext || v->proxy || !owns(v->type)) {
+        return;
+    }
+    Owner o = {0};
+    o.var = v;
+    o.region = w->region;
+    array_push(w->owners, o);
+}
+
+static Var *root_var(Ast *ast) {
+    while (ast) {
+        switch (ast->type) {
+        case AST_IDENTIFIER:
+            return ast->ident->var;
+        case AST_DOT:
+            ast = ast->dot->object;
+            break;
+        case AST_INDEX:
+            ast = ast->index->object;
+            break;
+        case AST_SLICE:
+            ast = ast->slice->object;
+            break;
+        case AST_CAST:
+            ast = ast->cast->object;
+            break;
+        default:
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static void pin(Walk *w, Ast *ast) {
+    Var *v = root_var(ast);
+    Owner *o = v ? find_owner(w, v) : NULL;
+    if (o) {
+        o->pinned = 1;
+    }
+}
+
+static void use(Walk *w, Ast *ast, int site) {
+    Owner *o = find_owner(w, ast->ident->var);
+    if (!o) {
+        return;
+    }
+    if (w->in_defer) {
+        o->pinned = 1;
+    }
+    if (o->last && o->last_stmt == w->stmt) {
+        o->stmt_uses++;
+    } else {
+        o->stmt_uses = 1;
+    }
+    o->last = ast;
+    o->last_region = w->region;
+    o->last_stmt = w->stmt;
+    o->last_movable = site && !w->conditional;
+}
+
+static void walk_statements(Walk *w, AstBlock *block) {
+    for (int i = 0; i < array_len(block->statements); i++) {
+        w->stmt = ++w->stmts;
+        walk(w, block->statements[i], 0);
+    }
+}
+
+static void walk_block(Walk *w, AstBlock *block) {
+    if (!block) {
+        return;
+    }
+    int region = w->region;
+    w->region = ++w->regions;
+    walk_statements(w, block);
+    w->region = region;
+}
+
+static void walk_condition(Walk *w, Ast *ast) {
+    w->conditional++;
+    walk(w, ast, 0);
+    w->conditional--;
+}
+
+// The element can be borrowed from the array rather than copied if nothing in
+// the body could free it: the body only calls extern functions, doesn't take
+// addresses, only assigns to plain locals, and assigns neither the element
+// nor the array.
+static void walk_for(Walk *w, Ast *ast) {
+    AstFor *loop = ast->for_loop;
+    walk(w, loop->iterable, 0);
+
+    int side_effects = w->side_effects;
+    int assigned = array_len(w->assigned);
+    int region = w->region;
+    w->region = ++w->regions;
+    if (!loop->by_reference) {
+        add_owner(w, loop->itervar);
+    }
+    walk_statements(w, loop->body);
+    w->region = region;
+
+    if (loop->by_reference || !owns(loop->itervar->type) || w->side_effects != side_effects) {
+        return;
+    }
+    Var *array = root_var(loop->iterable);
+    for (int i = assigned; i < array_len(w->assigned); i++) {
+        Var *v = w->assigned[i];
+        if (v->id == loop->itervar->id || (array && v->id == array->id)) {
+            return;
+        }
+    }
+    loop->borrowed = 1;
+    find_owner(w, loop->itervar)->pinned = 1;
+}
+
+static void walk(Walk *w, Ast *ast, int site) {
+    if (!ast) {
+        return;
+    }
+    switch (ast->type) {
+    case AST_IDENTIFIER:
+        use(w, ast, site);
+        break;
+    case AST_LITERAL:
+        if (ast->lit->lit_type == ARRAY_LIT || ast->lit->lit_type == STRUCT_LIT ||
+                ast->lit->lit_type == COMPOUND_LIT) {
+            for (int i = 0; i < array_len(ast->lit->compound_val.member_exprs); i++) {
+                walk(w, ast->lit->compound_val.member_exprs[i], 1);
+            }
+        }
+        break;
+    case AST_DOT:
+        walk(w, ast->dot->object, 0);
+        break;
+    case AST_ASSIGN:
+        if (ast->binary->left->type == AST_IDENTIFIER) {
+            array_push(w->assigned, ast->binary->left->ident->var);
+        } else {
+            w->side_effects++;
+        }
+        walk(w, ast->binary->left, 0);
+        walk(w, ast->binary->right, 1);
+        break;
+    case AST_BINOP:
+        walk(w, ast->binary->left, 0);
+        if (ast->binary->op == OP_AND || ast->binary->op == OP_OR) {
+            walk_condition(w, ast->binary->right);
+        } else {
+            walk(w, ast->binary->right, 0);
+        }
+        break;
+    case AST_UOP:
+        if (ast->unary->op == OP_REF) {
+            pin(w, ast->unary->object);
+            w->side_effects++;
+        }
+        walk(w, ast->unary->object, 0);
+        break;
+    case AST_COPY:
+        walk(w, ast->copy->expr, 0);
+        break;
+    case AST_DECL:
+        walk(w, ast->decl->init, 1);
+        if (!ast->decl->global) {
+            add_owner(w, ast->decl->var);
+        }
+        break;
+    case AST_CALL:
+        if (ast->call->fn->type != AST_IDENTIFIER || !ast->call->fn->ident->var->ext) {
+            w->side_effects++;
+        }
+        walk(w, ast->call->fn, 0);
+        for (int i = 0; i < array_len(ast->call->args); i++) {
+            walk(w, ast->call->args[i], 1);
+        }
+        break;
+    case AST_INDEX:
+        walk(w, ast->index->object, 0);
+        walk(w, ast->index->index, 0);
+        break;
+    case AST_SLICE:
+        walk(w, ast->slice->object, 0);
+        walk(w, ast->slice->offset, 0);
+        walk(w, ast->slice->length, 0);
+        break;
+    case AST_CONDITIONAL:
+        walk_condition(w, ast->cond->initializer);
+        walk_condition(w, ast->cond->condition);
+        walk_block(w, ast->cond->if_body);
+        walk_block(w, ast->cond->else_body);
+        break;
+    case AST_RETURN:
+        walk(w, ast->ret->expr, 1);
+        if (ast->ret->expr && ast->ret->expr->type == AST_IDENTIFIER) {
+            array_push(w->returns, ast->ret->expr);
+        }
+        break;
+    case AST_BLOCK:
+        walk_statements(w, ast->block);
+        break;
+    case AST_WHILE:
+        walk_condition(w, ast->while_loop->initializer);
+        walk_condition(w, ast->while_loop->condition);
+        walk_block(w, ast->while_loop->body);
+        break;
+    case AST_FOR:
+        walk_for(w, ast);
+        break;
+    case AST_ANON_SCOPE:
+        walk_block(w, ast->anon_scope->body);
+        break;
+    case AST_CAST:
+        walk(w, ast->cast->object, 0);
+        break;
+    case AST_DIRECTIVE:
+        walk(w, ast->directive->object, 0);
+        break;
+    case AST_USE:
+        pin(w, ast->use->object);
+        w->side_effects++;
+        walk(w, ast->use->object, 0);
+        break;
+    case AST_SPREAD:
+        walk(w, ast->spread->object, 0);
+        break;
+    case AST_NEW:
+        walk(w, ast->new->count, 0);
+        break;
+    case AST_DEFER:
+        w->in_defer++;
+        w->side_effects++;
+        walk(w, ast->defer->call, 0);
+        w->in_defer--;
+        break;
+    case AST_METHOD:
+        pin(w, ast->method->recv);
+        w->side_effects++;
+        walk(w, ast->method->recv, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+void find_moves(AstFnDecl *fn) {
+    Walk w = {0};
+    w.region = ++w.regions;
+    for (int i = 0; i < array_len(fn->args); i++) {
+        add_owner(&w, fn->args[i]);
+    }
+    walk_statements(&w, fn->body);
+
+    // The last use moves the value if it's the only use in a statement directly
+    // in the block the owner was declared in, so nothing after it can see the
+    // owner again, and only one thing in the statement can.
+    for (int i = 0; i < array_len(w.owners); i++) {
+        Owner *o = &w.owners[i];
+        if (!o->pinned && o->last && o->last_movable &&
+                o->last_region == o->region && o->stmt_uses == 1) {
+            o->last->ident->moved = 1;
+        }
+    }
+    // Returning an owner leaves the function, whatever the block.
+    for (int i = 0; i < array_len(w.returns); i++) {
+        Owner *o = find_owner(&w, w.returns[i]->ident->var);
+        if (o && !o->pinned) {
+            w.returns[i]->ident->moved = 1;
+        }
+    }
+    array_free(w.owners);
+    array_free(w.returns);
+    array_free(w.assigned);
+}
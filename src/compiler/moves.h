@@ -0,0 +1,12 @@
+#ifndef MOVES_H
+#define MOVES_H
+
+#include "ast.h"
+
+// Finds the places in a checked function where an owned string or struct is
+// used for the last time, and marks them (AstIdent.moved) so codegen hands the
+// value on instead of copying it. Also marks by-value for loops whose body
+// only reads the element (AstFor.borrowed), so the element isn't copied.
+void find_moves(AstFnDecl *fn);
+
+#endif
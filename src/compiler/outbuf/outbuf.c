@@ -0,0 +1,121 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "outbuf.h"
+
+#define MIN_CAP (1 << 16)
+#define MAX_INDENT 32
+
+static const char spaces[MAX_INDENT * 4 + 1] =
+    "                                                                "
+    "                                                                ";
+
+void outbuf_reserve(OutBuf *b, size_t n) {
+    if (b->cap - b->len >= n) {
+        return;
+    }
+    size_t cap = b->cap ? b->cap * 2 : MIN_CAP;
+    while (cap - b->len < n) {
+        cap *= 2;
+    }
+    b->data = realloc(b->data, cap);
+    if (b->data == NULL) {
+        abort();
+    }
+    b->cap = cap;
+}
+
+void outbuf_insert(OutBuf *b, size_t pos, const char *s, size_t n) {
+    outbuf_reserve(b, n);
+    memmove(b->data + pos + n, b->data + pos, b->len - pos);
+    memcpy(b->data + pos, s, n);
+    b->len += n;
+}
+
+void outbuf_flush(OutBuf *b) {
+    if (b->file && b->len) {
+        fwrite(b->data, 1, b->len, b->file);
+        fflush(b->file);
+    }
+    b->len = 0;
+}
+
+void outbuf_set_file(OutBuf *b, FILE *f) {
+    outbuf_flush(b);
+    b->file = f;
+}
+
+void outbuf_int(OutBuf *b, long n) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long u = n < 0 ? -(unsigned long)n : (unsigned long)n;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (n < 0) {
+        *--p = '-';
+    }
+    outbuf_write(b, p, digits + sizeof(digits) - p);
+}
+
+void outbuf_indent(OutBuf *b, int n) {
+    for (; n > MAX_INDENT; n -= MAX_INDENT) {
+        outbuf_write(b, spaces, MAX_INDENT * 4);
+    }
+    outbuf_write(b, spaces, n * 4);
+}
+
+void outbuf_quoted(OutBuf *b, const char *s) {
+    const char *run = s;
+    for (; *s; s++) {
+        char esc;
+        switch (*s) {
+        case 0x27: esc = '\''; break;
+        case 0x22: esc = '"'; break;
+        case 0x3f: esc = '?'; break;
+        case 0x5c: esc = '\\'; break;
+        case 0x07: esc = 'a'; break;
+        case 0x08: esc = 'b'; break;
+        case 0x0c: esc = 'f'; break;
+        case 0x0a: esc = 'n'; break;
+        case 0x0d: esc = 'r'; break;
+        case 0x09: esc = 't'; break;
+        case 0x0b: esc = 'v'; break;
+        default: continue;
+        }
+        outbuf_write(b, run, s - run);
+        outbuf_putc(b, '\\');
+        outbuf_putc(b, esc);
+        run = s + 1;
+    }
+    outbuf_write(b, run, s - run);
+}
+
+int outbuf_vprintf(OutBuf *b, const char *fmt, va_list args) {
+    if (b->data == NULL) {
+        outbuf_reserve(b, 1);
+    }
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, copy);
+    va_end(copy);
+    if (n >= 0 && (size_t)n >= b->cap - b->len) {
+        outbuf_reserve(b, n + 1);
+        n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, args);
+    }
+    if (n > 0) {
+        b->len += n;
+    }
+    return n;
+}
+
+int outbuf_printf(OutBuf *b, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = outbuf_vprintf(b, fmt, args);
+    va_end(args);
+    return n;
+}
@@ -0,0 +1,57 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Growable buffer for generated code. Everything written is kept in memory
+// and handed to the file in a single write by outbuf_flush, so the many small
+// fragments codegen produces don't each go through stdio.
+typedef struct OutBuf {
+    char *data;
+    size_t len;
+    size_t cap;
+    FILE *file;
+} OutBuf;
+
+// Writes out whatever is buffered, then starts buffering for f.
+void outbuf_set_file(OutBuf *b, FILE *f);
+// Hands the buffered bytes to the file (and fflushes it); the buffer is kept
+// for reuse.
+void outbuf_flush(OutBuf *b);
+void outbuf_reserve(OutBuf *b, size_t n);
+// Puts s at pos, moving everything after it along.
+void outbuf_insert(OutBuf *b, size_t pos, const char *s, size_t n);
+
+static inline void outbuf_write(OutBuf *b, const char *s, size_t n) {
+    if (b->cap - b->len < n) {
+        outbuf_reserve(b, n);
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static inline void outbuf_putc(OutBuf *b, char c) {
+    if (b->len == b->cap) {
+        outbuf_reserve(b, 1);
+    }
+    b->data[b->len++] = c;
+}
+
+static inline void outbuf_puts(OutBuf *b, const char *s) {
+    outbuf_write(b, s, strlen(s));
+}
+
+// s must be a string literal
+#define outbuf_lit(b, s) outbuf_write((b), (s), sizeof(s) - 1)
+
+void outbuf_int(OutBuf *b, long n);
+// n levels of four spaces
+void outbuf_indent(OutBuf *b, int n);
+// s with C escapes, to go between double quotes
+void outbuf_quoted(OutBuf *b, const char *s);
+int outbuf_printf(OutBuf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int outbuf_vprintf(OutBuf *b, const char *fmt, va_list args);
+
+#endif
@@ -4,23 +4,35 @@
 #include <string.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include "arena/arena.h"
 #include "array/array.h"
+#include "intern/intern.h"
 #include "package.h"
+#include "pool/pool.h"
 #include "scope.h"
 #include "parse.h"
+#include "timing/timing.h"
+#include "trace/trace.h"
 #include "token.h"
 #include "types.h"
+#include "util.h"
+#include "var.h"
 
 static Package *current_package;
 static Package **pkg_stack;
 
 Package *new_package(char *name, char *path) {
-    Package *p = calloc(sizeof(Package), 1);
+    Package *p = arena_new(Package);
     p->path = path;
-    p->name = name;
+    p->name = intern(name);
     p->scope = new_scope(NULL);
-    p->root = calloc(sizeof(AstBlock), 1);
+    p->root = arena_new(AstBlock);
     return p;
 }
 
@@ -28,13 +40,20 @@ Ast *check_semantics(Scope *scope, Ast *ast);
 Ast *check_block_semantics(Scope *scope, AstBlock *block, int fn_body);
 Ast *first_pass(Scope *scope, Ast *ast);
 
+static void adopt_preloaded_imports(Package *p);
+
 Package *package_check_semantics(Package *p) {
     if (p->semantics_checked) {
+        if (p->preloaded) {
+            adopt_preloaded_imports(p);
+        }
         return p;
     }
     p->semantics_checked = 1;
     push_current_package(p);
+    timing_begin(PHASE_CHECK, p->name);
     check_block_semantics(p->scope, p->root, 0);
+    timing_end();
     /*for (int i = 0; i < array_len(p->statements); i++) {*/
         /*p->statements[i] = check_semantics(p->scope, p->statements[i]);*/
     /*}*/
@@ -79,6 +98,34 @@ Package **all_loaded_packages() {
     return all_packages;
 }
 
+// Standard library packages checked by check_preloaded_packages. One only
+// joins all_packages once the program imports it, directly or not.
+static Package **preloaded_packages = NULL;
+
+static Package *find_preloaded(char *path) {
+    for (int i = 0; i < array_len(preloaded_packages); i++) {
+        if (!strcmp(preloaded_packages[i]->path, path)) {
+            return preloaded_packages[i];
+        }
+    }
+    return NULL;
+}
+
+// Takes in the imports of a preloaded package the way checking it would
+// have: all of them are loaded first, then each is checked.
+static void adopt_preloaded_imports(Package *p) {
+    p->preloaded = 0;
+    Package **imports = p->scope->imported_packages;
+    for (int i = 0; i < array_len(imports); i++) {
+        if (!package_previously_loaded(imports[i]->path)) {
+            array_push(all_packages, imports[i]);
+        }
+    }
+    for (int i = 0; i < array_len(imports); i++) {
+        package_check_semantics(imports[i]);
+    }
+}
+
 void push_current_package(Package *p) {
     array_push(pkg_stack, p);
     current_package = p;
@@ -111,6 +158,252 @@ char *package_path_from_import_string(char *imp) {
     return imp;
 }
 
+// With -j, every package reachable through imports is parsed ahead of time on
+// worker threads, one task per file, as soon as the file importing it has
+// been parsed. Checking stays on the main thread and in the usual order:
+// load_package adopts the prefetched files at the point where it would have
+// parsed them, and only then assigns their ids (file by file), so the output
+// doesn't depend on the number of threads. A package with a file that fails
+// to prefetch is parsed again serially, which reports the error at the usual
+// point.
+
+typedef enum {
+    PREFETCH_QUEUED,
+    PREFETCH_DONE,
+    PREFETCH_FAILED
+} PrefetchState;
+
+typedef struct PrefetchedFile {
+    struct Prefetch *package;
+    char *name;
+    Ast *ast;
+    int end_line;
+    struct timespec mtime;
+    IdLog ids;
+} PrefetchedFile;
+
+typedef struct Prefetch {
+    char *path;
+    char *name;
+    PrefetchState state;
+    char **filenames;
+    PrefetchedFile *files;
+    int pending; // files still being parsed
+    int failed;
+} Prefetch;
+
+__thread IdLog *id_log = NULL;
+
+static Pool *loader = NULL;
+static hashmap_t(Prefetch*) prefetches; // by package path
+static char **preloaded_paths = NULL; // see preload_packages
+static pthread_mutex_t prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_done = PTHREAD_COND_INITIALIZER;
+static int prefetches_queued = 0;
+
+static void prefetch_package(void *arg);
+
+static void queue_prefetch(char *path) {
+    pthread_mutex_lock(&prefetch_lock);
+    if (!hashmap_get(&prefetches, path)) {
+        Prefetch *pf = calloc(1, sizeof(Prefetch));
+        pf->path = path;
+        pf->name = package_name(path);
+        hashmap_put(&prefetches, path, pf);
+        prefetches_queued++;
+        pool_submit(loader, prefetch_package, pf);
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+}
+
+static void prefetch_imports(AstBlock *root) {
+    for (int i = 0; i < array_len(root->statements); i++) {
+        Ast *stmt = root->statements[i];
+        if (stmt->type != AST_IMPORT) {
+            continue;
+        }
+        queue_prefetch(package_path_from_import_string(stmt->import->path));
+    }
+}
+
+static void finish_prefetch(Prefetch *pf, int ok) {
+    pthread_mutex_lock(&prefetch_lock);
+    if (!ok) {
+        pf->failed = 1;
+    }
+    if (--pf->pending <= 0) {
+        pf->state = pf->failed ? PREFETCH_FAILED : PREFETCH_DONE;
+        prefetches_queued--;
+        pthread_cond_broadcast(&prefetch_done);
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+}
+
+static void prefetch_file(void *arg) {
+    PrefetchedFile *f = arg;
+    int ok = 0;
+    Lexer *prev = use_lexer(new_lexer());
+    jmp_buf trap;
+    error_trap = &trap;
+    id_log = &f->ids;
+    struct stat st;
+    if (stat(f->name, &st) == 0) {
+        f->mtime = st.st_mtim;
+    }
+    int depth = timing_depth();
+    int trace_at = trace_depth();
+    if (!setjmp(trap)) {
+        timing_begin(PHASE_PARSE, f->package->name);
+        f->ast = parse_source_file(0, "", f->name);
+        f->end_line = lineno();
+        timing_end();
+        ok = 1;
+    }
+    timing_unwind(depth);
+    trace_unwind(trace_at);
+    error_trap = NULL;
+    id_log = NULL;
+    free(use_lexer(prev));
+
+    if (ok) {
+        prefetch_imports(f->ast->block);
+    }
+    finish_prefetch(f->package, ok);
+}
+
+static void prefetch_package(void *arg) {
+    Prefetch *pf = arg;
+    jmp_buf trap;
+    error_trap = &trap;
+    if (!setjmp(trap)) {
+        pf->filenames = package_source_files(0, "", pf->path);
+    }
+    error_trap = NULL;
+
+    int n = array_len(pf->filenames);
+    if (n == 0) {
+        finish_prefetch(pf, 0);
+        return;
+    }
+    pf->files = calloc(n, sizeof(PrefetchedFile));
+    pf->pending = n;
+    for (int i = 0; i < n; i++) {
+        pf->files[i].package = pf;
+        pf->files[i].name = pf->filenames[i];
+        pool_submit(loader, prefetch_file, &pf->files[i]);
+    }
+}
+
+void start_package_loader(int threads, Ast *root) {
+    // resolve the root up front rather than racing to do it lazily
+    package_path_from_import_string("");
+    loader = pool_start(threads);
+    prefetch_imports(root->block);
+}
+
+static int has_verse_sources(DIR *d) {
+    struct dirent *ent = NULL;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_type == DT_REG && file_is_verse_source(ent->d_name, strlen(ent->d_name))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// rel is relative to the root's src/, either empty or ending in '/'
+static void preload_dir(char *rel) {
+    char *path = package_path_from_import_string(rel);
+    DIR *d = opendir(path);
+    if (!d) {
+        return;
+    }
+    if (rel[0] && has_verse_sources(d)) {
+        // import paths have no trailing slash
+        char *pkg = strndup(rel, strlen(rel) - 1);
+        char *path = package_path_from_import_string(pkg);
+        queue_prefetch(path);
+        array_push(preloaded_paths, path);
+        free(pkg);
+    }
+    rewinddir(d);
+    struct dirent *ent = NULL;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_type != DT_DIR || ent->d_name[0] == '.') {
+            continue;
+        }
+        int len = strlen(rel) + strlen(ent->d_name) + 1;
+        char *sub = malloc(sizeof(char) * (len + 1));
+        snprintf(sub, len + 1, "%s%s/", rel, ent->d_name);
+        preload_dir(sub);
+        free(sub);
+    }
+    closedir(d);
+}
+
+// Prefetches every package under the root's src/ directory and waits for
+// them all, so that processes forked afterwards find the standard library
+// already parsed (see -serve).
+void preload_packages(int threads) {
+    package_path_from_import_string("");
+    loader = pool_start(threads);
+    preload_dir("");
+    pthread_mutex_lock(&prefetch_lock);
+    while (prefetches_queued > 0) {
+        pthread_cond_wait(&prefetch_done, &prefetch_lock);
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+}
+
+// A preloaded package may have been edited since (see preload_packages), in
+// which case it is parsed again.
+static int prefetch_current(Prefetch *pf) {
+    DIR *d = opendir(pf->path);
+    if (!d) {
+        return 0;
+    }
+    closedir(d);
+    char **filenames = package_source_files(0, "", pf->path);
+    int current = array_len(filenames) == array_len(pf->filenames);
+    for (int i = 0; current && i < array_len(filenames); i++) {
+        struct stat st;
+        struct timespec *m = &pf->files[i].mtime;
+        current = !strcmp(filenames[i], pf->filenames[i]) && stat(filenames[i], &st) == 0 &&
+            st.st_mtim.tv_sec == m->tv_sec && st.st_mtim.tv_nsec == m->tv_nsec;
+    }
+    for (int i = 0; i < array_len(filenames); i++) {
+        free(filenames[i]);
+    }
+    array_free(filenames);
+    return current;
+}
+
+// Waits for the package at path to be prefetched, if it was queued at all,
+// and gives its contents their ids.
+static Prefetch *take_prefetched(char *path) {
+    if (loader == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&prefetch_lock);
+    Prefetch **found = hashmap_get(&prefetches, path);
+    Prefetch *pf = found ? *found : NULL;
+    while (pf && pf->state == PREFETCH_QUEUED) {
+        pthread_cond_wait(&prefetch_done, &prefetch_lock);
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+    if (pf == NULL || pf->state == PREFETCH_FAILED || !prefetch_current(pf)) {
+        return NULL;
+    }
+    for (int i = 0; i < array_len(pf->filenames); i++) {
+        IdLog *ids = &pf->files[i].ids;
+        assign_ast_ids(ids->asts);
+        assign_var_ids(ids->vars);
+        assign_type_ids(ids->types);
+        name_anon_fns(ids->anon_fns);
+    }
+    return pf;
+}
+
 Package *load_package(int from_line, char *current_file, Scope *scope, char *path) {
     path = package_path_from_import_string(path);
     Package *p = package_previously_loaded(path);
@@ -123,18 +416,35 @@ Package *load_package(int from_line, char *current_file, Scope *scope, char *pat
         array_push(scope->imported_packages, p);
         return p;
     }
+    p = find_preloaded(path);
+    if (p) {
+        array_push(all_packages, p);
+        array_push(scope->imported_packages, p);
+        return p;
+    }
     p = new_package(package_name(path), path);
+    trace_begin("package", p->name, path);
 
-    char **filenames = package_source_files(lineno(), current_file, path);
+    Prefetch *pf = take_prefetched(path);
+    char **filenames = pf ? pf->filenames : package_source_files(lineno(), current_file, path);
     if (!filenames) {
         error(lineno(), current_file, "No verse source files found in package '%s' ('%s').", p->name, p->path);
     }
 
     push_current_package(p);
     for (int i = 0; i < array_len(filenames); i++) {
-        Ast *file_ast = parse_source_file(from_line, current_file, filenames[i]);
-        PkgFile *f = malloc(sizeof(PkgFile));
-        f->name = path;
+        Ast *file_ast = NULL;
+        if (pf) {
+            push_parsed_file_source(filenames[i], pf->files[i].end_line);
+            file_ast = pf->files[i].ast;
+        } else {
+            timing_begin(PHASE_PARSE, p->name);
+            file_ast = parse_source_file(from_line, current_file, filenames[i]);
+            timing_end();
+        }
+        PkgFile *f = arena_new(PkgFile);
+        f->package = p;
+        f->name = filenames[i];
         f->start_index = array_len(p->root->statements);
         for (int i = 0; i < array_len(file_ast->block->statements); i++) {
             array_push(p->root->statements, file_ast->block->statements[i]);
@@ -146,9 +456,182 @@ Package *load_package(int from_line, char *current_file, Scope *scope, char *pat
 
     array_push(all_packages, p);
     array_push(scope->imported_packages, p);
+    trace_end();
     return p;
 }
 
+static int by_path(const void *a, const void *b) {
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+// Loads every preloaded package in paths that parsed, and checks them in
+// order, each under its own error trap. Returns which ones failed to check,
+// along with every package importing one of those.
+static char *check_packages(Scope *scope, char **paths) {
+    int n = array_len(paths);
+    Package **loaded = calloc(n, sizeof(Package *));
+    char *failed = calloc(n, 1);
+    // every package is loaded before any is checked, then checked in turn
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            if (failed[i]) {
+                continue;
+            }
+            jmp_buf trap;
+            error_trap = &trap;
+            int stack = array_len(pkg_stack);
+            int depth = timing_depth();
+            int trace_at = trace_depth();
+            if (setjmp(trap)) {
+                // everything still being checked (the package with the
+                // error and any importing it) didn't finish
+                failed[i] = 1;
+                for (int j = stack; j < array_len(pkg_stack); j++) {
+                    for (int k = 0; k < n; k++) {
+                        if (loaded[k] == pkg_stack[j]) {
+                            failed[k] = 1;
+                        }
+                    }
+                }
+                array_raw_len(pkg_stack) = stack;
+                current_package = pkg_stack[stack - 1];
+                timing_unwind(depth);
+                trace_unwind(trace_at);
+            } else if (pass == 0) {
+                loaded[i] = load_package(0, "", scope, paths[i]);
+            } else {
+                package_check_semantics(loaded[i]);
+            }
+            error_trap = NULL;
+        }
+    }
+    // a package importing a failed one only got as far as it did because
+    // the failed one was already marked as checked
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int i = 0; i < n; i++) {
+            if (failed[i]) {
+                continue;
+            }
+            Package **imports = loaded[i]->scope->imported_packages;
+            for (int j = 0; !failed[i] && j < array_len(imports); j++) {
+                for (int k = 0; k < n; k++) {
+                    if (failed[k] && loaded[k] == imports[j]) {
+                        failed[i] = 1;
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+    free(loaded);
+    return failed;
+}
+
+// Leaves a package for each compile to parse and check again.
+static void skip_preloaded(char *path) {
+    Prefetch *pf = *hashmap_get(&prefetches, path);
+    pf->state = PREFETCH_FAILED;
+    fprintf(stderr, "compile server: not preloading '%s', which doesn't check\n", path);
+}
+
+// Checks the preloaded packages that parsed, in path order, as if a program
+// had imported them all, so that processes forked afterwards find the
+// standard library already checked. They are kept aside rather than loaded:
+// a program only takes in the packages it imports (see load_package).
+//
+// A package that fails to check is left out, along with the packages
+// importing it, so that each compile loads it again and reports the error
+// where it would without a server. Which ones fail is found out in a
+// throwaway fork first, since a failed check leaves its state half done.
+void check_preloaded_packages(Scope *scope) {
+    qsort(preloaded_paths, array_len(preloaded_paths), sizeof(char *), by_path);
+    char **paths = NULL;
+    for (int i = 0; i < array_len(preloaded_paths); i++) {
+        Prefetch *pf = *hashmap_get(&prefetches, preloaded_paths[i]);
+        if (pf->state == PREFETCH_DONE) {
+            array_push(paths, preloaded_paths[i]);
+        }
+    }
+
+    int n = array_len(paths);
+    char *failed = calloc(n, 1);
+    int fds[2];
+    pid_t pid = -1;
+    if (n > 0 && pipe(fds) == 0) {
+        pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            char *child_failed = check_packages(scope, paths);
+            int written = 0;
+            while (written < n) {
+                ssize_t w = write(fds[1], child_failed + written, n - written);
+                if (w <= 0) {
+                    _exit(1);
+                }
+                written += w;
+            }
+            _exit(0);
+        }
+        close(fds[1]);
+        int got = 0;
+        while (pid > 0 && got < n) {
+            ssize_t r = read(fds[0], failed + got, n - got);
+            if (r <= 0) {
+                break;
+            }
+            got += r;
+        }
+        close(fds[0]);
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+        // if the trial didn't finish, nothing is known to check
+        if (got < n) {
+            memset(failed, 1, n);
+        }
+    }
+
+    char **ok = NULL;
+    for (int i = 0; i < n; i++) {
+        if (failed[i]) {
+            skip_preloaded(paths[i]);
+        } else {
+            array_push(ok, paths[i]);
+        }
+    }
+    char *ok_failed = check_packages(scope, ok);
+    for (int i = 0; i < array_len(ok); i++) {
+        if (ok_failed[i]) {
+            skip_preloaded(ok[i]);
+        } else {
+            Package *p = package_previously_loaded(ok[i]);
+            p->preloaded = 1;
+            array_push(preloaded_packages, p);
+        }
+    }
+    free(ok_failed);
+    array_free(all_packages);
+    all_packages = NULL;
+    array_free(scope->imported_packages);
+    scope->imported_packages = NULL;
+    array_free(ok);
+    array_free(paths);
+    free(failed);
+}
+
+// Reports whether a package checked by check_preloaded_packages has been
+// edited since, which leaves the checked state out of date.
+int preloaded_packages_changed() {
+    for (int i = 0; i < array_len(preloaded_paths); i++) {
+        Prefetch *pf = *hashmap_get(&prefetches, preloaded_paths[i]);
+        if (pf->state == PREFETCH_DONE && !prefetch_current(pf)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 char **package_source_files(int from_line, char *from_file, char *package_path) {
     DIR *d = opendir(package_path);
     if (!d) {
@@ -179,7 +662,7 @@ Package *lookup_imported_package(Scope *scope, char *name) {
         scope = scope->parent;
     }
     for (int i = 0; i < array_len(scope->imported_packages); i++) {
-        if (!strcmp(scope->imported_packages[i]->name, name)) {
+        if (scope->imported_packages[i]->name == name) {
             return scope->imported_packages[i];
         }
     }
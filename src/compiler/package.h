@@ -17,5 +17,12 @@ char *package_path_from_import_string(char *imp);
 char **package_source_files(int from_line, char *from_file, char *package_path);
 Package *lookup_imported_package(Scope *scope, char *name);
 int file_is_verse_source(char *name, int namelen);
+void start_package_loader(int threads, struct Ast *root);
+void preload_packages(int threads);
+void check_preloaded_packages(Scope *scope);
+int preloaded_packages_changed();
+
+// set while parsing on a worker thread
+extern __thread IdLog *id_log;
 
 #endif // PACKAGE_H
@@ -3,10 +3,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena/arena.h"
 #include "array/array.h"
 #include "eval.h"
+#include "intern/intern.h"
+#include "package.h"
 #include "parse.h"
 #include "semantics.h"
+#include "trace/trace.h"
 #include "var.h"
 #include "util.h"
 
@@ -87,7 +91,6 @@ Ast *parse_array_index(Ast *object) {
     t = next_token();
     if (t->type == TOK_COLON) {
         Ast *offset = ind->index->index;
-        free(ind);
         return parse_array_slice(object, offset);
     } else if (t->type != TOK_RSQUARE) {
         error(lineno(), current_file_name(), "Unexpected token '%s' while parsing array index.", tok_to_string(t));
@@ -574,14 +577,26 @@ Ast *parse_extern_func_decl() {
     return func; 
 }
 
+static char *next_anon_fn_name() {
+    int len = snprintf(NULL, 0, "%d", last_tmp_fn_id);
+    char *fname = malloc(sizeof(char) * (len + 1));
+    snprintf(fname, len+1, "%d", last_tmp_fn_id++);
+    fname[len] = 0;
+    return fname;
+}
+
+void name_anon_fns(Ast **fns) {
+    for (int i = 0; i < array_len(fns); i++) {
+        fns[i]->fn_decl->var->name = intern(next_anon_fn_name());
+    }
+}
+
 Ast *parse_func_decl(int anonymous) {
     Tok *t;
     char *fname = NULL;
     if (anonymous) {
-        int len = snprintf(NULL, 0, "%d", last_tmp_fn_id);
-        fname = malloc(sizeof(char) * (len + 1));
-        snprintf(fname, len+1, "%d", last_tmp_fn_id++);
-        fname[len] = 0;
+        // on a worker thread the name is filled in by name_anon_fns
+        fname = id_log ? "" : next_anon_fn_name();
     } else {
         t = expect(TOK_ID);
         fname = t->sval;
@@ -590,6 +605,9 @@ Ast *parse_func_decl(int anonymous) {
 
     Ast *func = ast_alloc(anonymous ? AST_ANON_FUNC_DECL : AST_FUNC_DECL);
     func->fn_decl->args = NULL;
+    if (anonymous && id_log) {
+        array_push(id_log->anon_fns, func);
+    }
 
     int variadic = 0;
     Var **args = func->fn_decl->args;
@@ -1218,7 +1236,7 @@ Ast *parse_conditional() {
         if (!next) {
             error(lineno(), current_file_name(), "Unexpected EOF while parsing conditional.");
         } else if (next->type == TOK_IF) {
-            AstBlock *block = calloc(sizeof(AstBlock), 1);
+            AstBlock *block = arena_new(AstBlock);
 
             block->file = current_file_name();
             block->startline = lineno();
@@ -1260,7 +1278,7 @@ Ast **parse_statement_list() {
 }
 
 AstBlock *parse_astblock(int bracketed) {
-    AstBlock *block = calloc(sizeof(AstBlock), 1);
+    AstBlock *block = arena_new(AstBlock);
 
     block->startline = lineno();
     block->file = current_file_name();
@@ -1300,7 +1318,10 @@ Ast *parse_source_file(int line, char *source_file, char *filename) {
         error(line, source_file, "Could not open source file '%s': %s", filename, err);
     }
     push_file_source(filename, f);
-    return parse_block(0);
+    trace_begin("parse", filename, NULL);
+    Ast *ast = parse_block(0);
+    trace_end();
+    return ast;
 }
 
 // TODO: why is this here
@@ -1381,4 +1402,39 @@ void init_builtins() {
         v->constant = 1;
         define_builtin(v);
     }
+
+    {
+        Type **arg_types = NULL;
+        array_push(arg_types, make_ref_type(get_string_builder_type()));
+        array_push(arg_types, base_type(STRING_T));
+        Type **ret_types = NULL;
+        array_push(ret_types, base_type(VOID_T));
+        Var *v = make_var("sb_append", make_fn_type(arg_types, ret_types, 0));
+        v->ext = 1;
+        v->constant = 1;
+        define_builtin(v);
+    }
+
+    {
+        Type **arg_types = NULL;
+        array_push(arg_types, make_ref_type(get_string_builder_type()));
+        array_push(arg_types, base_numeric_type(UINT_T, 8));
+        Type **ret_types = NULL;
+        array_push(ret_types, base_type(VOID_T));
+        Var *v = make_var("sb_append_byte", make_fn_type(arg_types, ret_types, 0));
+        v->ext = 1;
+        v->constant = 1;
+        define_builtin(v);
+    }
+
+    {
+        Type **arg_types = NULL;
+        array_push(arg_types, make_ref_type(get_string_builder_type()));
+        Type **ret_types = NULL;
+        array_push(ret_types, base_type(STRING_T));
+        Var *v = make_var("sb_string", make_fn_type(arg_types, ret_types, 0));
+        v->ext = 1;
+        v->constant = 1;
+        define_builtin(v);
+    }
 }
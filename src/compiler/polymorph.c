@@ -1,15 +1,44 @@
 #include <stdlib.h>
 
+#include "arena/arena.h"
 #include "array/array.h"
 #include "hashmap/hashmap.h"
 
 #include "polymorph.h"
 #include "typechecking.h"
 
+#define POLYMORPH_BUCKETS_MIN 8
+
+static int total_hits = 0;
+static int total_misses = 0;
+
+// Only a prefix of the arg types is ever compared (a variadic call can leave
+// off the last one), so the hash covers just the fixed args.
+static unsigned int hash_arg_types(AstFnDecl *decl, Type **arg_types) {
+    int n = array_len(decl->args);
+    if (decl->var->type->resolved->fn.variadic) {
+        n--;
+    }
+    if (n > array_len(arg_types)) {
+        n = array_len(arg_types);
+    }
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < n; i++) {
+        h = (h ^ type_hash(arg_types[i])) * 16777619u;
+    }
+    return h;
+}
+
+static void bucket_polymorph(AstFnDecl *decl, Polymorph *p) {
+    int nbuckets = array_len(decl->polymorph_buckets);
+    array_push(decl->polymorph_buckets[p->args_hash & (nbuckets - 1)], p);
+}
+
 Polymorph *create_polymorph(AstFnDecl *decl, Type **arg_types) {
-    Polymorph *p = malloc(sizeof(Polymorph));
+    Polymorph *p = arena_new(Polymorph);
     p->id = array_len(decl->polymorphs);
     p->args = arg_types;
+    p->args_hash = hash_arg_types(decl, arg_types);
     p->scope = new_fn_scope(decl->scope);
     p->scope->fn_var = decl->var;
     p->scope->polymorph = p;
@@ -18,24 +47,79 @@ Polymorph *create_polymorph(AstFnDecl *decl, Type **arg_types) {
     p->var = NULL;
     hashmap_init(&p->defs);
     array_push(decl->polymorphs, p);
+
+    int nbuckets = array_len(decl->polymorph_buckets);
+    if (array_len(decl->polymorphs) <= nbuckets) {
+        bucket_polymorph(decl, p);
+        return p;
+    }
+    for (int i = 0; i < nbuckets; i++) {
+        array_free(decl->polymorph_buckets[i]);
+    }
+    array_free(decl->polymorph_buckets);
+    decl->polymorph_buckets = NULL;
+    nbuckets = nbuckets ? nbuckets * 2 : POLYMORPH_BUCKETS_MIN;
+    for (int i = 0; i < nbuckets; i++) {
+        array_push(decl->polymorph_buckets, NULL);
+    }
+    for (int i = 0; i < array_len(decl->polymorphs); i++) {
+        bucket_polymorph(decl, decl->polymorphs[i]);
+    }
     return p;
 }
 
+// The same id is enough when check_type would take it: once through any
+// aliases, and unless both types are named and the names differ.
+static int arg_matches(Type *a, Type *b) {
+    while (a && a->aka) {
+        a = a->aka;
+    }
+    while (b && b->aka) {
+        b = b->aka;
+    }
+    if (a && b && a->id == b->id && (!a->name || !b->name || a->name == b->name)) {
+        return 1;
+    }
+    return check_type(a, b);
+}
+
 Polymorph *check_for_existing_polymorph(AstFnDecl *decl, Type **arg_types) {
     Polymorph *match = NULL;
-    for (int i = 0; i < array_len(decl->polymorphs); i++) {
-        Polymorph *p = decl->polymorphs[i];
-        for (int j = 0; j < array_len(p->args); j++) {
+    int nbuckets = array_len(decl->polymorph_buckets);
+    if (nbuckets > 0) {
+        // type_hash agrees with check_type, so equal arg types always share
+        // a bucket, and buckets keep creation order, so the first match is
+        // the one a scan of decl->polymorphs would find
+        unsigned int h = hash_arg_types(decl, arg_types);
+        Polymorph **bucket = decl->polymorph_buckets[h & (nbuckets - 1)];
+        for (int i = 0; i < array_len(bucket) && !match; i++) {
+            Polymorph *p = bucket[i];
+            if (p->args_hash != h) {
+                continue;
+            }
             match = p;
-            if (!check_type(p->args[j], arg_types[j])) {
-                match = NULL;
-                break;
+            for (int j = 0; j < array_len(p->args); j++) {
+                if (!arg_matches(p->args[j], arg_types[j])) {
+                    match = NULL;
+                    break;
+                }
             }
         }
-        if (match) {
-            return match;
-        }
     }
-    return NULL;
+    if (match) {
+        decl->polymorph_hits++;
+        total_hits++;
+    } else {
+        decl->polymorph_misses++;
+        total_misses++;
+    }
+    return match;
 }
 
+int polymorph_cache_hits() {
+    return total_hits;
+}
+
+int polymorph_cache_misses() {
+    return total_misses;
+}
@@ -6,5 +6,7 @@
 
 Polymorph *create_polymorph(AstFnDecl *decl, Type **arg_types);
 Polymorph *check_for_existing_polymorph(AstFnDecl *decl, Type **arg_types);
+int polymorph_cache_hits();
+int polymorph_cache_misses();
 
 #endif
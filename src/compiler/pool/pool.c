@@ -0,0 +1,67 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+typedef struct Task {
+    void (*fn)(void *);
+    void *arg;
+    struct Task *next;
+} Task;
+
+struct Pool {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Task *head;
+    Task *tail;
+};
+
+static void *worker(void *arg) {
+    Pool *pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->head == NULL) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        Task *t = pool->head;
+        pool->head = t->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        t->fn(t->arg);
+        free(t);
+    }
+    return NULL;
+}
+
+Pool *pool_start(int threads) {
+    Pool *pool = calloc(1, sizeof(Pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    for (int i = 0; i < threads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker, pool) != 0) {
+            abort();
+        }
+        pthread_detach(t);
+    }
+    return pool;
+}
+
+void pool_submit(Pool *pool, void (*fn)(void *), void *arg) {
+    Task *t = malloc(sizeof(Task));
+    t->fn = fn;
+    t->arg = arg;
+    t->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) {
+        pool->tail->next = t;
+    } else {
+        pool->head = t;
+    }
+    pool->tail = t;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
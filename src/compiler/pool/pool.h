@@ -0,0 +1,12 @@
+#ifndef POOL_H
+#define POOL_H
+
+// A fixed set of worker threads running submitted tasks in FIFO order.
+// Workers live until the process exits.
+
+typedef struct Pool Pool;
+
+Pool *pool_start(int threads);
+void pool_submit(Pool *pool, void (*fn)(void *), void *arg);
+
+#endif
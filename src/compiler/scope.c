@@ -3,26 +3,32 @@
 #include <string.h>
 #include <dirent.h>
 
+#include "arena/arena.h"
 #include "array/array.h"
 #include "hashmap/hashmap.h"
+#include "timing/timing.h"
 #include "scope.h"
 #include "parse.h"
 #include "package.h"
 #include "semantics.h"
 
-static Var **builtin_vars = NULL;
+// scopes with at most this many vars are just scanned
+#define VAR_INDEX_MIN 8
+
+static Scope *builtin_vars_scope = NULL;
 
 void define_builtin(Var *v) {
-    array_push(builtin_vars, v);
+    if (builtin_vars_scope == NULL) {
+        builtin_vars_scope = new_scope(NULL);
+    }
+    attach_var(builtin_vars_scope, v);
 }
 
 Var *find_builtin_var(char *name) {
-    for (int i = 0; i < array_len(builtin_vars); i++) {
-        if (!strcmp(builtin_vars[i]->name, name)) {
-            return builtin_vars[i];
-        }
+    if (builtin_vars_scope == NULL) {
+        return NULL;
     }
-    return NULL;
+    return lookup_local_var(builtin_vars_scope, name);
 }
 
 static Scope *builtin_types_scope = NULL;
@@ -37,12 +43,189 @@ Type **builtin_types() {
 
 static Type **used_types = NULL;
 
+// Canonical type table: indexes into used_types bucketed by type_hash, and
+// the first used type seen with each type id, so finding the existing
+// equivalent of a type doesn't mean running check_type against all of them.
+static unsigned int *used_type_hashes = NULL;
+static int **used_type_buckets = NULL;
+static int *used_type_by_id = NULL;
+
+#define USED_TYPE_BUCKETS_MIN 256
+
 Type **all_used_types() {
     return used_types;
 }
 
+int check_type(Type *a, Type *b);
+unsigned int type_hash(Type *t);
+
+static int used_type_index(Type *t) {
+    int found = -1;
+    if (t->id >= 0 && t->id < array_len(used_type_by_id)) {
+        int i = used_type_by_id[t->id];
+        if (i >= 0 && used_types[i]->id == t->id) {
+            found = i;
+        }
+    }
+    int nbuckets = array_len(used_type_buckets);
+    if (nbuckets > 0) {
+        unsigned int h = type_hash(t);
+        int *bucket = used_type_buckets[h & (nbuckets - 1)];
+        // buckets are in insertion order, so the first match is the one a
+        // linear scan of used_types would have found
+        for (int j = 0; j < array_len(bucket); j++) {
+            int i = bucket[j];
+            if (found >= 0 && i >= found) {
+                break;
+            }
+            if (used_type_hashes[i] == h && check_type(used_types[i], t)) {
+                found = i;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// Records that the current package uses used type i, see used_types_of.
+static void note_used_type(int i) {
+    Package *p = get_current_package();
+    if (p == NULL) {
+        return;
+    }
+    int n = array_len(p->used_type_refs);
+    if (n == 0 || p->used_type_refs[n-1] != i) {
+        array_push(p->used_type_refs, i);
+    }
+}
+
+Type *find_used_type(Type *t) {
+    int found = used_type_index(t);
+    if (found < 0) {
+        return NULL;
+    }
+    note_used_type(found);
+    return used_types[found];
+}
+
+static void keep_used_type(char *keep, int **pending, Type *t) {
+    if (t == NULL) {
+        return;
+    }
+    int i = used_type_index(t);
+    if (i >= 0 && !keep[i]) {
+        keep[i] = 1;
+        array_push(*pending, i);
+    }
+}
+
+// Returns the used types that the given packages found or added, along with
+// the types they are made of, in the order they were added.
+Type **used_types_of(Package **packages) {
+    int n = array_len(used_types);
+    char *keep = calloc(n, 1);
+    int *pending = NULL;
+    for (int i = 0; i < array_len(packages); i++) {
+        int *refs = packages[i]->used_type_refs;
+        for (int j = 0; j < array_len(refs); j++) {
+            if (!keep[refs[j]]) {
+                keep[refs[j]] = 1;
+                array_push(pending, refs[j]);
+            }
+        }
+    }
+    while (array_len(pending) > 0) {
+        ResolvedType *r = used_types[pending[array_len(pending)-1]]->resolved;
+        array_raw_len(pending) -= 1;
+        if (r == NULL) {
+            continue;
+        }
+        switch (r->comp) {
+        case STRUCT:
+            for (int i = 0; i < array_len(r->st.member_types); i++) {
+                keep_used_type(keep, &pending, r->st.member_types[i]);
+            }
+            break;
+        case ENUM:
+            keep_used_type(keep, &pending, r->en.inner);
+            break;
+        case ARRAY:
+        case STATIC_ARRAY:
+            keep_used_type(keep, &pending, r->array.inner);
+            break;
+        case REF:
+            keep_used_type(keep, &pending, r->ref.inner);
+            break;
+        case FUNC:
+            for (int i = 0; i < array_len(r->fn.args); i++) {
+                keep_used_type(keep, &pending, r->fn.args[i]);
+            }
+            for (int i = 0; i < array_len(r->fn.ret); i++) {
+                keep_used_type(keep, &pending, r->fn.ret[i]);
+            }
+            break;
+        case PARAMS:
+            for (int i = 0; i < array_len(r->params.args); i++) {
+                keep_used_type(keep, &pending, r->params.args[i]);
+            }
+            keep_used_type(keep, &pending, r->params.inner);
+            break;
+        default:
+            break;
+        }
+    }
+    Type **out = NULL;
+    for (int i = 0; i < n; i++) {
+        if (keep[i]) {
+            array_push(out, used_types[i]);
+        }
+    }
+    array_free(pending);
+    free(keep);
+    return out;
+}
+
+static void bucket_used_type(int i) {
+    int nbuckets = array_len(used_type_buckets);
+    array_push(used_type_buckets[used_type_hashes[i] & (nbuckets - 1)], i);
+}
+
+static void add_used_type(Type *t) {
+    int i = array_len(used_types);
+    array_push(used_types, t);
+    note_used_type(i);
+    array_push(used_type_hashes, type_hash(t));
+
+    if (t->id >= 0) {
+        while (array_len(used_type_by_id) <= t->id) {
+            array_push(used_type_by_id, -1);
+        }
+        if (used_type_by_id[t->id] < 0) {
+            used_type_by_id[t->id] = i;
+        }
+    }
+
+    int nbuckets = array_len(used_type_buckets);
+    if (i + 1 <= nbuckets) {
+        bucket_used_type(i);
+        return;
+    }
+    for (int b = 0; b < nbuckets; b++) {
+        array_free(used_type_buckets[b]);
+    }
+    array_free(used_type_buckets);
+    used_type_buckets = NULL;
+    nbuckets = nbuckets ? nbuckets * 2 : USED_TYPE_BUCKETS_MIN;
+    for (int b = 0; b < nbuckets; b++) {
+        array_push(used_type_buckets, NULL);
+    }
+    for (int j = 0; j <= i; j++) {
+        bucket_used_type(j);
+    }
+}
+
 Scope *new_scope(Scope *parent) {
-    Scope *s = calloc(sizeof(Scope), 1);
+    Scope *s = arena_new(Scope);
     s->parent = parent;
     s->type = parent ? Simple : Root;
     s->package = parent ? parent->package : get_current_package();
@@ -122,27 +305,29 @@ Type *lookup_type(Scope *s, char *name) {
     return lookup_local_type(builtin_types_scope, name);
 }
 
-int check_type(Type *a, Type *b);
-
-void register_type(Type *t) {
+static void register_used_type(Type *t) {
     if (t->name) {
         TypeDef *tmp = find_type_definition(t);
         if (tmp && tmp->type == t) {
             return;
         }
-    }
-    for (int i = 0; i < array_len(used_types); i++) {
-        if (used_types[i]->id == t->id) {
-            return;
+        // fill in what check_type would on its first compare, so the type
+        // doesn't change under the table once it's in there
+        if (tmp && !t->resolved) {
+            t->id = tmp->type->id;
+            t->resolved = tmp->type->resolved;
         }
-        if (check_type(used_types[i], t)) {
-            /*t->id = used_types[i]->id;*/
-            *t = *used_types[i];
-            return;
+    }
+    Type *found = find_used_type(t);
+    if (found) {
+        if (found->id != t->id) {
+            /*t->id = found->id;*/
+            *t = *found;
         }
+        return;
     }
 
-    array_push(used_types, t);
+    add_used_type(t);
 
     ResolvedType *resolved = t->resolved;
     if (!resolved) {
@@ -152,45 +337,51 @@ void register_type(Type *t) {
     switch (resolved->comp) {
     case STRUCT:
         for (int i = 0; i < array_len(resolved->st.member_types); i++) {
-            register_type(resolved->st.member_types[i]);
+            register_used_type(resolved->st.member_types[i]);
         }
         break;
     case ENUM:
-        register_type(resolved->en.inner);
+        register_used_type(resolved->en.inner);
         break;
     case ARRAY:
     case STATIC_ARRAY:
-        register_type(resolved->array.inner);
+        register_used_type(resolved->array.inner);
         break;
     case REF:
-        register_type(resolved->ref.inner);
+        register_used_type(resolved->ref.inner);
         break;
     case FUNC:
         for (int i = 0; i < array_len(resolved->fn.args); i++) {
-            register_type(resolved->fn.args[i]);
+            register_used_type(resolved->fn.args[i]);
         }
         for (int i = 0; i < array_len(resolved->fn.ret); i++) {
-            register_type(resolved->fn.ret[i]);
+            register_used_type(resolved->fn.ret[i]);
         }
         break;
     case PARAMS:
         for (int i = 0; i < array_len(resolved->params.args); i++) {
-            register_type(resolved->params.args[i]);
+            register_used_type(resolved->params.args[i]);
         }
-        register_type(resolved->params.inner);
+        register_used_type(resolved->params.inner);
         break;
     default:
         break;
     }
 }
 
+void register_type(Type *t) {
+    timing_begin(PHASE_REGISTER_TYPES, NULL);
+    register_used_type(t);
+    timing_end();
+}
+
 Type *define_polymorph(Scope *s, Type *poly, Type *type, Ast *ast) {
     assert(poly->resolved->comp == POLYDEF);
     assert(s->polymorph != NULL);
     if (lookup_local_type(s, poly->name) != NULL) {
         error(-1, "internal", "Type '%s' already declared within this scope.", poly->name);
     }
-    TypeDef *td = malloc(sizeof(TypeDef));
+    TypeDef *td = arena_new(TypeDef);
     td->name = poly->name;
     td->type = resolve_polymorph_recursively(type); // may not need this?
     td->ast = ast;
@@ -260,7 +451,7 @@ Type *define_type(Scope *s, char *name, Type *type, Ast *ast) {
     if (!(type->resolved && type->resolved->comp == STRUCT && type->resolved->st.generic)) {
         register_type(named);
     }
-    TypeDef *td = malloc(sizeof(TypeDef));
+    TypeDef *td = arena_new(TypeDef);
     td->name = name;
     td->type = named;
     td->ast = ast;
@@ -271,7 +462,7 @@ Type *define_type(Scope *s, char *name, Type *type, Ast *ast) {
 
 Type *add_proxy_type(Scope *s, Package *src, TypeDef *orig) {
     assert(orig->type->resolved);
-    TypeDef *td = malloc(sizeof(TypeDef));
+    TypeDef *td = arena_new(TypeDef);
     td->name = orig->name;
     td->type = orig->type;
     td->proxy = src;
@@ -305,52 +496,51 @@ TypeDef *find_type_definition(Type *t) {
     return NULL;
 }
 
+static void index_var(Scope *scope, Var *v) {
+    // temp vars are unnamed, and the first var with a given name wins
+    if (v->name[0] && !hashmap_get(&scope->var_index, v->name)) {
+        hashmap_put(&scope->var_index, v->name, v);
+    }
+}
+
+void attach_var(Scope *scope, Var *v) {
+    array_push(scope->vars, v);
+    int n = array_len(scope->vars);
+    if (n > VAR_INDEX_MIN + 1) {
+        index_var(scope, v);
+    } else if (n == VAR_INDEX_MIN + 1) {
+        for (int i = 0; i < n; i++) {
+            index_var(scope, scope->vars[i]);
+        }
+    }
+}
+
 Var *lookup_local_var(Scope *scope, char *name) {
+    if (array_len(scope->vars) > VAR_INDEX_MIN) {
+        Var **v = hashmap_get(&scope->var_index, name);
+        return v ? *v : NULL;
+    }
     for (int i = 0; i < array_len(scope->vars); i++) {
         Var *v = scope->vars[i];
-        if (!strcmp(v->name, name)) {
+        if (v->name == name) {
             return v;
         }
     }
     return NULL;
 }
 
-static Var *_lookup_var(Scope *scope, char *name) {
-    Var *v = lookup_local_var(scope, name);
-    int in_function = scope->type == Function;
-    while (v == NULL && scope->parent != NULL) {
-        v = lookup_var(scope->parent, name);
-        if (v != NULL) {
-            if (!in_function || v->constant) {
-                return v;
-            }
-            v = NULL;
-        }
-        scope = scope->parent;
-        in_function = in_function || scope->type == Function;
-    }
-    return v;
-}
-
 Var *lookup_var(Scope *scope, char *name) {
-    Var *v = _lookup_var(scope, name);
-    if (v) {
-        return v;
-    }
-    // package global
-    while (scope->parent != NULL) {
-        scope = scope->parent;
-    }
-    v = lookup_local_var(scope, name);
-    if (v) {
-        return v;
-    }
-    for (int i = 0; i < array_len(builtin_vars); i++) {
-        if (!strcmp(builtin_vars[i]->name, name)) {
-            return builtin_vars[i];
+    int crossed_fn = 0;
+    for (Scope *s = scope; s != NULL; s = s->parent) {
+        Var *v = lookup_local_var(s, name);
+        // once outside of the current function, only constants and package
+        // globals are visible
+        if (v != NULL && (!crossed_fn || v->constant || s->parent == NULL)) {
+            return v;
         }
+        crossed_fn = crossed_fn || s->type == Function;
     }
-    return NULL;
+    return find_builtin_var(name);
 }
 
 TempVar *allocate_ast_temp_var(Scope *scope, struct Ast *ast) {
@@ -360,9 +550,9 @@ TempVar *allocate_ast_temp_var(Scope *scope, struct Ast *ast) {
 TempVar *make_temp_var(Scope *scope, Type *t, int id) {
     Var *v = make_var("", t);
     v->temp = 1;
-    array_push(scope->vars, v);
+    attach_var(scope, v);
 
-    TempVar *tv = malloc(sizeof(TempVar));
+    TempVar *tv = arena_new(TempVar);
     tv->var = v;
     tv->ast_id = id;
     array_push(scope->temp_vars, tv);
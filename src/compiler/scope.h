@@ -27,6 +27,7 @@ int local_type_name_conflict(Scope *scope, char *name);
 void register_type(Type *t);
 
 void attach_var(Scope *scope, Var *var);
+// var names are interned, so these expect an interned name
 Var *lookup_local_var(Scope *scope, char *name);
 Var *lookup_var(Scope *scope, char *name);
 
@@ -41,5 +42,7 @@ Var *find_builtin_var(char *name);
 void init_builtin_types();
 Type **builtin_types();
 Type **all_used_types();
+Type **used_types_of(Package **packages);
+Type *find_used_type(Type *t);
 
 #endif
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -8,6 +9,8 @@
 #include "parse.h"
 #include "package.h"
 #include "polymorph.h"
+#include "timing/timing.h"
+#include "trace/trace.h"
 #include "types.h"
 #include "typechecking.h"
 
@@ -319,7 +322,7 @@ static Ast *check_ident_semantics(Scope *scope, Ast *ast) {
         Type *t = resolve_type(v->type);
         if (t->resolved->comp == ENUM) { // proxy for enum
             for (int i = 0; i < array_len(t->resolved->en.member_names); i++) {
-                if (!strcmp(t->resolved->en.member_names[i], v->name)) {
+                if (t->resolved->en.member_names[i] == v->name) {
                     Ast *a = ast_alloc(AST_LITERAL);
                     a->line = ast->line;
                     a->file = ast->file;
@@ -343,6 +346,15 @@ static Ast *check_ident_semantics(Scope *scope, Ast *ast) {
     return ast;
 }
 
+// A string slice that is only compared, appended, indexed, measured or sliced
+// again doesn't outlive the expression it's in, so it can borrow the string's
+// bytes instead of copying them.
+static void borrow_string_slice(Ast *ast) {
+    if (ast->type == AST_SLICE && is_string(ast->var_type)) {
+        ast->slice->borrowed = 1;
+    }
+}
+
 static Ast *check_dot_op_semantics(Scope *scope, Ast *ast) {
     if (ast->dot->object->type == AST_IDENTIFIER) {
         ast->dot->object = check_ident_semantics(scope, ast->dot->object);
@@ -359,7 +371,7 @@ static Ast *check_dot_op_semantics(Scope *scope, Ast *ast) {
         AstTypeIdent *tp = ast->dot->object->type_ident;
         if (tp->type->resolved->comp == ENUM) {
             for (int i = 0; i < array_len(tp->type->resolved->en.member_names); i++) {
-                if (!strcmp(tp->type->resolved->en.member_names[i], ast->dot->member_name)) {
+                if (tp->type->resolved->en.member_names[i] == ast->dot->member_name) {
                     Ast *a = ast_alloc(AST_LITERAL);
                     a->lit->lit_type = ENUM_LIT;
                     a->lit->enum_val.enum_index = i;
@@ -460,6 +472,7 @@ static Ast *check_dot_op_semantics(Scope *scope, Ast *ast) {
         }
     } else if (is_string(t)) {
         if (!strcmp(ast->dot->member_name, "length")) {
+            borrow_string_slice(ast->dot->object);
             ast->var_type = base_type(INT_T);
         } else if (!strcmp(ast->dot->member_name, "bytes")) {
             ast->var_type = make_ref_type(base_numeric_type(UINT_T, 8));
@@ -469,7 +482,7 @@ static Ast *check_dot_op_semantics(Scope *scope, Ast *ast) {
         }
     } else if (t->resolved->comp == STRUCT) {
         for (int i = 0; i < array_len(t->resolved->st.member_names); i++) {
-            if (!strcmp(ast->dot->member_name, t->resolved->st.member_names[i])) {
+            if (ast->dot->member_name == t->resolved->st.member_names[i]) {
                 ast->var_type = t->resolved->st.member_types[i];
                 return ast;
             }
@@ -596,6 +609,22 @@ static Ast *check_binop_semantics(Scope *scope, Ast *ast) {
         break;
     }
 
+    if (is_string(lt) && (ast->binary->op == OP_PLUS || is_comparison(ast->binary->op))) {
+        borrow_string_slice(ast->binary->left);
+        borrow_string_slice(ast->binary->right);
+    }
+
+    // the parts of a + are only copied from, so any that are temporaries
+    // are kept to be freed with the scope's other temps
+    if (is_string(lt) && ast->binary->op == OP_PLUS) {
+        if (needs_concat_temp_var(ast->binary->left)) {
+            allocate_ast_temp_var(scope, ast->binary->left);
+        }
+        if (needs_concat_temp_var(ast->binary->right)) {
+            allocate_ast_temp_var(scope, ast->binary->right);
+        }
+    }
+
     if (l->type == AST_LITERAL && r->type == AST_LITERAL) {
         // TODO: this doesn't work for string slices
         return eval_const_binop(ast);
@@ -758,8 +787,8 @@ Ast *first_pass(Scope *scope, Ast *ast) {
                 error(ast->line, ast->file, "Declared function name '%s' already exists in this scope.", ast->fn_decl->var->name);
             }
 
-            array_push(scope->vars, ast->fn_decl->var);
-            array_push(ast->fn_decl->scope->vars, ast->fn_decl->var);
+            attach_var(scope, ast->fn_decl->var);
+            attach_var(ast->fn_decl->scope, ast->fn_decl->var);
         }
 
         first_pass_type(ast->fn_decl->scope, ast->fn_decl->var->type);
@@ -942,9 +971,16 @@ Ast *first_pass(Scope *scope, Ast *ast) {
 }
 
 AstBlock *check_block_semantics(Scope *scope, AstBlock *block, int fn_body) {
+    // nested blocks get their first pass while they're being checked
+    if (scope->type == Root) {
+        timing_begin(PHASE_FIRST_PASS, NULL);
+    }
     for (int i = 0; i < array_len(block->statements); i++) {
         block->statements[i] = first_pass(scope, block->statements[i]);
     }
+    if (scope->type == Root) {
+        timing_end();
+    }
 
     if (scope->type == Root) {
         for (int i = 0; i < array_len(block->statements); i++) {
@@ -1204,7 +1240,7 @@ static Ast *check_use_semantics(Scope *scope, Ast *ast) {
             a->lit->enum_val.enum_type = t;
             a->var_type = t;
             v->proxy = a;
-            array_push(scope->vars, v);
+            attach_var(scope, v);
         }
         return ast;
     } else if (ast->use->object->type == AST_PACKAGE) {
@@ -1231,7 +1267,7 @@ static Ast *check_use_semantics(Scope *scope, Ast *ast) {
             dot->line = ast->line;
             dot->file = ast->file;
             new_v->proxy = dot;
-            array_push(scope->vars, new_v);
+            attach_var(scope, new_v);
         }
         iter_t iter = hashmap_iter();
         TypeDef **t;
@@ -1276,7 +1312,7 @@ static Ast *check_use_semantics(Scope *scope, Ast *ast) {
         dot->line = ast->line;
         dot->file = ast->file;
         v->proxy = check_semantics(scope, dot);
-        array_push(scope->vars, v);
+        attach_var(scope, v);
     }
     return ast;
 }
@@ -1285,6 +1321,7 @@ static Ast *check_slice_semantics(Scope *scope, Ast *ast) {
     AstSlice *slice = ast->slice;
 
     slice->object = check_semantics(scope, slice->object);
+    borrow_string_slice(slice->object);
     if (needs_temp_var(slice->object)) {
         allocate_ast_temp_var(scope, slice->object);
     }
@@ -1475,7 +1512,7 @@ static Ast *check_declaration_semantics(Scope *scope, Ast *ast) {
     if (scope->parent == NULL) {
         ast->decl->global = 1;
         define_global(decl->var);
-        array_push(scope->vars, ast->decl->var); // should this be after the init parsing?
+        attach_var(scope, ast->decl->var); // should this be after the init parsing?
 
         if (decl->init != NULL) {
             Ast *id = ast_alloc(AST_IDENTIFIER);
@@ -1492,7 +1529,7 @@ static Ast *check_declaration_semantics(Scope *scope, Ast *ast) {
             return ast;
         }
     } else {
-        array_push(scope->vars, ast->decl->var); // should this be after the init parsing?
+        attach_var(scope, ast->decl->var); // should this be after the init parsing?
     }
 
     return ast;
@@ -1611,6 +1648,20 @@ static AstFnDecl *get_fn_decl(Ast *ast) {
     return decl;
 }
 
+// e.g. "(int, string)", for -trace
+static char *polymorph_signature(Type **arg_types) {
+    char *out = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&out, &len);
+    fprintf(f, "(");
+    for (int i = 0; i < array_len(arg_types); i++) {
+        fprintf(f, i ? ", %s" : "%s", type_to_string(arg_types[i]));
+    }
+    fprintf(f, ")");
+    fclose(f);
+    return out;
+}
+
 static Ast *check_poly_call_semantics(Scope *scope, Ast *ast, Type *fn_type) {
     assert(fn_type->resolved->comp == FUNC);
     // collect call arg types
@@ -1670,6 +1721,11 @@ static Ast *check_poly_call_semantics(Scope *scope, Ast *ast, Type *fn_type) {
         ast->var_type = resolve_polymorph_recursively(match->ret[0]);
         return ast;
     } else {
+        if (trace_enabled()) {
+            char *signature = polymorph_signature(call_arg_types);
+            trace_begin("polymorph", decl->var->name, signature);
+            free(signature);
+        }
         match = create_polymorph(decl, call_arg_types);
     }
 
@@ -1698,7 +1754,7 @@ static Ast *check_poly_call_semantics(Scope *scope, Ast *ast, Type *fn_type) {
             if (r->fn.variadic && i == array_len(r->fn.args) - 1) {
                 v->type = make_array_type(v->type);
             }
-            array_push(match->scope->vars, v);
+            attach_var(match->scope, v);
             // TODO: I think this case might be wrong
             array_push(arg_vars, v);
             array_push(fn_arg_types, v->type);
@@ -1773,6 +1829,7 @@ static Ast *check_poly_call_semantics(Scope *scope, Ast *ast, Type *fn_type) {
 
     match->ret = ret; // this is used in the body, must be done before check_block_semantics
     generated_ast = check_semantics(match->scope, generated_ast);
+    trace_end();
 
     Ast *id = ast_alloc(AST_IDENTIFIER);
     id->line = ast->call->fn->line;
@@ -1964,7 +2021,7 @@ static Ast *check_func_decl_semantics(Scope *scope, Ast *ast) {
                     }
                     fn_args[i] = a;
                 }
-                array_push(ast->fn_decl->scope->vars, ast->fn_decl->args[i]);
+                attach_var(ast->fn_decl->scope, ast->fn_decl->args[i]);
             }
         }
 
@@ -2026,7 +2083,7 @@ static Ast *check_func_decl_semantics(Scope *scope, Ast *ast) {
                     dot->line = ast->line;
                     dot->file = ast->file;
                     v->proxy = check_semantics(ast->fn_decl->scope, first_pass(ast->fn_decl->scope, dot));
-                    array_push(ast->fn_decl->scope->vars, v);
+                    attach_var(ast->fn_decl->scope, v);
                 }
             }
         }
@@ -2052,6 +2109,7 @@ static Ast *check_func_decl_semantics(Scope *scope, Ast *ast) {
 static Ast *check_index_semantics(Scope *scope, Ast *ast) {
     ast->index->object = check_semantics(scope, ast->index->object);
     ast->index->index = check_semantics(scope, ast->index->index);
+    borrow_string_slice(ast->index->object);
     if (needs_temp_var(ast->index->object)) {
         allocate_ast_temp_var(scope, ast->index->object);
     }
@@ -2265,12 +2323,15 @@ Ast *check_semantics(Scope *scope, Ast *ast) {
             }
         }
 
-        array_push(scope->vars, ast->fn_decl->var);
+        attach_var(scope, ast->fn_decl->var);
         define_global(ast->fn_decl->var);
         break;
     case AST_ANON_FUNC_DECL:
     case AST_FUNC_DECL:
-        return check_func_decl_semantics(scope, ast);
+        trace_begin("check", fn_decl_name(ast->fn_decl), ast->file);
+        ast = check_func_decl_semantics(scope, ast);
+        trace_end();
+        return ast;
     case AST_CALL:
         return check_call_semantics(scope, ast);
     case AST_INDEX: 
@@ -2368,7 +2429,7 @@ Ast *check_semantics(Scope *scope, Ast *ast) {
                 error(ast->line, ast->file, "Index variable '%s' has type '%s', which is not an integer type.", lp->index->name, type_to_string(t));
             }
             // TODO: check for overflow of index type on static array
-            array_push(lp->scope->vars, lp->index);
+            attach_var(lp->scope, lp->index);
         }
 
         Type *it_type = lp->iterable->var_type;
@@ -2391,7 +2452,7 @@ Ast *check_semantics(Scope *scope, Ast *ast) {
             lp->itervar->type = make_ref_type(lp->itervar->type);
         }
         // TODO type check for when type of itervar is explicit
-        array_push(lp->scope->vars, lp->itervar);
+        attach_var(lp->scope, lp->itervar);
         lp->body = check_block_semantics(lp->scope, lp->body, 0);
 
         ast->var_type = base_type(VOID_T);
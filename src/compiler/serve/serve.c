@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "serve.h"
+#include "../array/array.h"
+
+static int socket_addr(char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+static int write_all(int fd, const void *buf, size_t n) {
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return 0;
+        }
+        p += w;
+        n -= w;
+    }
+    return 1;
+}
+
+static int read_all(int fd, void *buf, size_t n) {
+    char *p = buf;
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return 0;
+        }
+        p += r;
+        n -= r;
+    }
+    return 1;
+}
+
+// A request is the length of its body, sent along with the client's fds 0, 1
+// and 2, then the body: the working directory and the arguments, each
+// NUL-terminated.
+static int send_request(int sock, char *cwd, int argc, char **argv) {
+    uint32_t len = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    char *body = malloc(len);
+    char *p = body;
+    p = stpcpy(p, cwd) + 1;
+    for (int i = 0; i < argc; i++) {
+        p = stpcpy(p, argv[i]) + 1;
+    }
+
+    int fds[3] = {0, 1, 2};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {.iov_base = &len, .iov_len = sizeof(len)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    int ok = sendmsg(sock, &msg, 0) == sizeof(len) && write_all(sock, body, len);
+    free(body);
+    return ok;
+}
+
+// Returns the working directory followed by the arguments.
+static char **recv_request(int sock, int fds[3]) {
+    uint32_t len = 0;
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct iovec iov = {.iov_base = &len, .iov_len = sizeof(len)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sock, &msg, 0) != sizeof(len)) {
+        return NULL;
+    }
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (!c || c->cmsg_type != SCM_RIGHTS || c->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
+        return NULL;
+    }
+    memcpy(fds, CMSG_DATA(c), sizeof(int) * 3);
+
+    char *body = malloc(len + 1);
+    if (!read_all(sock, body, len)) {
+        free(body);
+        return NULL;
+    }
+    body[len] = '\0';
+    char **strs = NULL;
+    for (char *p = body; p < body + len; p += strlen(p) + 1) {
+        array_push(strs, p);
+    }
+    return strs;
+}
+
+static int handle(int conn, int (*run)(int argc, char **argv)) {
+    int fds[3];
+    char **req = recv_request(conn, fds);
+    if (array_len(req) < 2) {
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        dprintf(fds[2], "compile server: fork failed: %s\n", strerror(errno));
+        return 1;
+    }
+    if (pid == 0) {
+        close(conn);
+        for (int i = 0; i < 3; i++) {
+            dup2(fds[i], i);
+            if (fds[i] != i) {
+                close(fds[i]);
+            }
+        }
+        if (chdir(req[0]) != 0) {
+            fprintf(stderr, "compile server: could not change to '%s': %s\n", req[0], strerror(errno));
+            exit(1);
+        }
+        int argc = array_len(req) - 1;
+        array_push(req, NULL);
+        exit(run(argc, req + 1));
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    write_all(conn, &code, sizeof(code));
+    return 0;
+}
+
+int serve(char *socket_path, int (*run)(int argc, char **argv)) {
+    struct sockaddr_un addr;
+    if (!socket_addr(socket_path, &addr)) {
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    // a socket left behind by a previous server
+    unlink(socket_path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, 64)) {
+        close(sock);
+        return -1;
+    }
+    // handlers are never waited for
+    signal(SIGCHLD, SIG_IGN);
+    for (;;) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            close(sock);
+            return -1;
+        }
+        // each request is handled in a fork of the server as it was at
+        // startup, which forks again to run the compile and wait for it
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sock);
+            signal(SIGCHLD, SIG_DFL);
+            exit(handle(conn, run));
+        }
+        close(conn);
+    }
+}
+
+int serve_request(char *socket_path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    if (!socket_addr(socket_path, &addr)) {
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    char cwd[PATH_MAX];
+    int32_t code = -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+            !getcwd(cwd, sizeof(cwd)) ||
+            !send_request(sock, cwd, argc, argv) ||
+            !read_all(sock, &code, sizeof(code))) {
+        code = -1;
+    }
+    close(sock);
+    return code;
+}
@@ -0,0 +1,16 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+// A compile server on a unix socket. Each connection carries one compile: the
+// client's working directory and arguments, plus its stdin, stdout and stderr,
+// which are passed over the socket. The server forks a child for each
+// request, which calls run with those in place of its own, and sends the
+// child's exit status back.
+
+// Only returns if the socket can't be set up.
+int serve(char *socket_path, int (*run)(int argc, char **argv));
+// Returns the exit status of the compile, or -1 if the server can't be
+// reached.
+int serve_request(char *socket_path, int argc, char **argv);
+
+#endif
@@ -0,0 +1,258 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "timing.h"
+#include "../array/array.h"
+
+#define MAX_DEPTH 64
+#define MAX_PENDING 8
+
+__thread long timing_allocs = 0;
+__thread long timing_alloc_bytes = 0;
+
+typedef struct Entry {
+    char *package;
+    Phase phase;
+    double wall;
+    double cpu;
+    long allocs;
+    long bytes;
+} Entry;
+
+// what an entry has been charged since the thread's CPU clock was last read
+typedef struct Pending {
+    Entry *entry;
+    double wall;
+    long allocs;
+    long bytes;
+} Pending;
+
+static const char *phase_names[NUM_PHASES] = {
+    "lex",
+    "parse",
+    "first pass",
+    "check",
+    "register types",
+    "emit declarations",
+    "emit typeinfo",
+    "emit functions",
+    "write output",
+};
+
+static int enabled = 0;
+static double start_wall;
+static Entry **entries = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread Entry *stack[MAX_DEPTH];
+static __thread int depth = 0;
+static __thread Pending pending[MAX_PENDING];
+static __thread int num_pending = 0;
+static __thread Entry *light_entries[NUM_PHASES];
+static __thread double last_wall;
+static __thread double last_cpu;
+static __thread long last_allocs;
+static __thread long last_bytes;
+
+static double clock_secs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Lexing happens a token at a time and register_type once for most
+// expressions, while reading the thread's CPU clock is a system call. Around
+// these only the wall clock is read, and they get a share of the CPU time of
+// the phase they're in proportional to their wall time.
+static int light(Phase phase) {
+    return phase == PHASE_LEX || phase == PHASE_REGISTER_TYPES;
+}
+
+static Entry *find_entry(char *package, Phase phase) {
+    pthread_mutex_lock(&lock);
+    Entry *e = NULL;
+    for (int i = 0; i < array_len(entries); i++) {
+        if (entries[i]->phase == phase && !strcmp(entries[i]->package, package)) {
+            e = entries[i];
+            break;
+        }
+    }
+    if (!e) {
+        e = calloc(1, sizeof(Entry));
+        e->package = package;
+        e->phase = phase;
+        array_push(entries, e);
+    }
+    pthread_mutex_unlock(&lock);
+    return e;
+}
+
+// Splits the CPU time since the last read between the pending entries.
+static void flush() {
+    double cpu = clock_secs(CLOCK_THREAD_CPUTIME_ID);
+    double spent = cpu - last_cpu;
+    last_cpu = cpu;
+    double wall = 0;
+    for (int i = 0; i < num_pending; i++) {
+        wall += pending[i].wall;
+    }
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < num_pending; i++) {
+        Pending *p = &pending[i];
+        p->entry->wall += p->wall;
+        p->entry->cpu += wall > 0 ? spent * p->wall / wall : spent / num_pending;
+        p->entry->allocs += p->allocs;
+        p->entry->bytes += p->bytes;
+    }
+    pthread_mutex_unlock(&lock);
+    num_pending = 0;
+}
+
+// Charges everything since the last transition to the innermost phase.
+static void charge() {
+    double wall = clock_secs(CLOCK_MONOTONIC);
+    if (depth > 0) {
+        Entry *e = stack[depth - 1];
+        Pending *p = NULL;
+        for (int i = 0; i < num_pending; i++) {
+            if (pending[i].entry == e) {
+                p = &pending[i];
+                break;
+            }
+        }
+        if (!p) {
+            if (num_pending == MAX_PENDING) {
+                flush();
+            }
+            p = &pending[num_pending++];
+            *p = (Pending){e, 0, 0, 0};
+        }
+        p->wall += wall - last_wall;
+        p->allocs += timing_allocs - last_allocs;
+        p->bytes += timing_alloc_bytes - last_bytes;
+    } else {
+        last_cpu = clock_secs(CLOCK_THREAD_CPUTIME_ID);
+    }
+    last_wall = wall;
+    last_allocs = timing_allocs;
+    last_bytes = timing_alloc_bytes;
+}
+
+void timing_enable() {
+    enabled = 1;
+    start_wall = clock_secs(CLOCK_MONOTONIC);
+}
+
+void timing_begin(Phase phase, char *package) {
+    if (!enabled) {
+        return;
+    }
+    if (depth >= MAX_DEPTH) {
+        depth++;
+        return;
+    }
+    charge();
+    if (!package) {
+        package = depth > 0 ? stack[depth - 1]->package : "";
+    }
+    Entry *e = NULL;
+    if (light(phase)) {
+        e = light_entries[phase];
+        if (!e || e->package != package) {
+            e = light_entries[phase] = find_entry(package, phase);
+        }
+    } else {
+        flush();
+        e = find_entry(package, phase);
+    }
+    stack[depth++] = e;
+}
+
+void timing_end() {
+    if (!enabled) {
+        return;
+    }
+    if (depth > MAX_DEPTH) {
+        depth--;
+        return;
+    }
+    charge();
+    Phase phase = stack[--depth]->phase;
+    if (!light(phase) || depth == 0) {
+        flush();
+    }
+}
+
+int timing_depth() {
+    return depth;
+}
+
+void timing_unwind(int to) {
+    while (enabled && depth > to) {
+        timing_end();
+    }
+}
+
+static void print_row(FILE *f, const char *name, double wall, double cpu, long allocs, long bytes) {
+    fprintf(f, "  %-22s %9.2f %9.2f %9ld %11ld\n", name, wall * 1000, cpu * 1000, allocs, bytes);
+}
+
+void timing_report(FILE *f) {
+    if (!enabled) {
+        return;
+    }
+    Entry totals[NUM_PHASES] = {{0}};
+    Entry all = {0};
+    char **packages = NULL;
+    for (int i = 0; i < array_len(entries); i++) {
+        Entry *e = entries[i];
+        Entry *t = &totals[e->phase];
+        t->wall += e->wall;
+        t->cpu += e->cpu;
+        t->allocs += e->allocs;
+        t->bytes += e->bytes;
+        all.wall += e->wall;
+        all.cpu += e->cpu;
+        all.allocs += e->allocs;
+        all.bytes += e->bytes;
+
+        int seen = 0;
+        for (int j = 0; !seen && j < array_len(packages); j++) {
+            seen = !strcmp(packages[j], e->package);
+        }
+        if (!seen && e->package[0]) {
+            array_push(packages, e->package);
+        }
+    }
+
+    fprintf(f, "time report (allocations are those made through the arena and arrays)\n");
+    fprintf(f, "  %-22s %9s %9s %9s %11s\n", "phase", "wall ms", "cpu ms", "allocs", "bytes");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        Entry *t = &totals[i];
+        print_row(f, phase_names[i], t->wall, t->cpu, t->allocs, t->bytes);
+    }
+    print_row(f, "total", all.wall, all.cpu, all.allocs, all.bytes);
+
+    for (int i = 0; i < array_len(packages); i++) {
+        fprintf(f, "\n%s\n", packages[i]);
+        for (int phase = 0; phase < NUM_PHASES; phase++) {
+            for (int j = 0; j < array_len(entries); j++) {
+                Entry *e = entries[j];
+                if (e->phase == phase && !strcmp(e->package, packages[i])) {
+                    print_row(f, phase_names[phase], e->wall, e->cpu, e->allocs, e->bytes);
+                }
+            }
+        }
+    }
+    array_free(packages);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    fprintf(f, "\nelapsed %.2f ms, cpu %.2f ms, max rss %ld KB\n",
+            (clock_secs(CLOCK_MONOTONIC) - start_wall) * 1000, cpu * 1000, usage.ru_maxrss);
+}
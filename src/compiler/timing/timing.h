@@ -0,0 +1,40 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+
+// Per-phase, per-package wall time, CPU time and allocations, for
+// -time-report. Phases nest (parsing an import happens during the first pass
+// of the file importing it, lexing during parsing), and each is only charged
+// for the time it wasn't inside another one. Does nothing until enabled.
+
+typedef enum Phase {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_FIRST_PASS,
+    PHASE_CHECK,
+    PHASE_REGISTER_TYPES,
+    PHASE_EMIT_DECLS,
+    PHASE_EMIT_TYPEINFO,
+    PHASE_EMIT_FNS,
+    PHASE_WRITE_OUTPUT,
+    NUM_PHASES
+} Phase;
+
+// allocations made by the calling thread, counted by the arena and arrays
+extern __thread long timing_allocs;
+extern __thread long timing_alloc_bytes;
+
+#define timing_note_alloc(n) (timing_allocs++, timing_alloc_bytes += (n))
+
+void timing_enable();
+// package NULL means the package of the enclosing phase
+void timing_begin(Phase phase, char *package);
+void timing_end();
+// For code that can longjmp out of phases: note the depth before, and unwind
+// to it afterwards.
+int timing_depth();
+void timing_unwind(int depth);
+void timing_report(FILE *f);
+
+#endif
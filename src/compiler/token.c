@@ -2,7 +2,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "arena/arena.h"
+#include "intern/intern.h"
+#include "timing/timing.h"
 #include "token.h"
 #include "types.h"
 #include "util.h"
@@ -10,80 +16,163 @@
 typedef struct FileStack {
     char *name;
     int line;
-    FILE *handle;
+    // the whole file lives in one buffer, which is never released since
+    // identifiers, strings and comments are handed out as slices into it
+    char *buf;
+    char *pos;
+    char *end;
+    // identifiers are terminated in place, and the character that was
+    // overwritten is kept here until the scanner moves past it
+    char *saved_pos;
+    char saved_char;
     struct FileStack *next;
 } FileStack;
 
-static FileStack *source_stack = NULL;
-static Tok *_last_token = NULL;
+// Everything the tokenizer needs to keep between calls. Each file parsed on
+// a worker thread gets its own (see use_lexer).
+struct Lexer {
+    FileStack *files;
+    Tok *last_token;
+};
+
+static __thread Lexer *lexer = NULL;
+
+Lexer *new_lexer() {
+    return calloc(1, sizeof(Lexer));
+}
+
+// Makes l the current thread's lexer, returning the previous one.
+Lexer *use_lexer(Lexer *l) {
+    Lexer *prev = lexer;
+    lexer = l;
+    return prev;
+}
+
+static char *read_whole_file(FILE *f, long *len) {
+    long alloc = 4096;
+    long n = 0;
+    char *buf = malloc(alloc);
+    size_t r;
+    while ((r = fread(buf + n, 1, alloc - n - 1, f)) > 0) {
+        n += r;
+        if (n == alloc - 1) {
+            alloc *= 2;
+            buf = realloc(buf, alloc);
+        }
+    }
+    buf[n] = 0;
+    *len = n;
+    return buf;
+}
+
+static char *map_source(FILE *f, long *len) {
+    struct stat st;
+    long page = sysconf(_SC_PAGESIZE);
+    // the tail of the last page is zero-filled, which gives us a terminating
+    // NUL for free unless the file is an exact multiple of the page size
+    if (f != stdin && fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size > 0 && st.st_size % page != 0) {
+        char *buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+        if (buf != MAP_FAILED) {
+            *len = st.st_size;
+            return buf;
+        }
+    }
+    return read_whole_file(f, len);
+}
 
 void push_file_source(char *name, FILE *f) {
+    if (lexer == NULL) {
+        lexer = new_lexer();
+    }
     FileStack *stack = malloc(sizeof(struct FileStack));
+    long len = 0;
     stack->name = name;
     stack->line = 1;
-    stack->handle = f;
-    stack->next = source_stack;
-    source_stack = stack;
+    stack->buf = map_source(f, &len);
+    stack->pos = stack->buf;
+    stack->end = stack->buf + len;
+    stack->saved_pos = NULL;
+    stack->saved_char = 0;
+    stack->next = lexer->files;
+    lexer->files = stack;
+    if (f != stdin) {
+        fclose(f);
+    }
 }
 
 void pop_file_source() {
-    if (source_stack->handle != stdin) {
-        fclose(source_stack->handle);
+    lexer->files = lexer->files->next;
+}
+
+// Leaves a file that was already parsed elsewhere on the stack, positioned at
+// its end, as if it had just been read here.
+void push_parsed_file_source(char *name, int line) {
+    if (lexer == NULL) {
+        lexer = new_lexer();
     }
-    source_stack = source_stack->next;
+    FileStack *stack = calloc(1, sizeof(struct FileStack));
+    stack->name = name;
+    stack->line = line;
+    stack->next = lexer->files;
+    lexer->files = stack;
 }
 
+
 char get_char() {
-    return fgetc(source_stack->handle);
+    FileStack *s = lexer->files;
+    if (s->pos >= s->end) {
+        s->pos++;
+        return EOF;
+    }
+    if (s->pos == s->saved_pos) {
+        s->pos++;
+        return s->saved_char;
+    }
+    return *s->pos++;
 }
 
 void unget_char(char c) {
-    ungetc(c, source_stack->handle);
+    lexer->files->pos--;
+}
+
+// Terminates the slice ending just before the scan position, which must be
+// the (already ungotten) character following it.
+static void terminate_here() {
+    FileStack *s = lexer->files;
+    if (s->pos >= s->end) {
+        return;
+    }
+    s->saved_char = *s->pos;
+    s->saved_pos = s->pos;
+    *s->pos = '\0';
 }
 
 char *read_block_comment(int store) {
-    int alloc = 8;
-    int len = 0;
     int count = 1;
     char c;
-    int start = source_stack->line;
-    char *buf = NULL;
-    if (store) {
-        buf = malloc(alloc);
-    }
+    int start = lexer->files->line;
+    char *buf = lexer->files->pos;
     while ((c = get_char()) != EOF) {
-        if (c == '/') {
-            if (store) {
-                buf[len++] = c;
-                if (len == alloc - 1) {
-                    alloc *= 2;
-                    buf = realloc(buf, alloc);
-                }
-            }
-            c = get_char();
-            if (c == '*') {
+        if (c == '\n') {
+            lexer->files->line++;
+        } else if (c == '/') {
+            if ((c = get_char()) == '*') {
                 count++;
+            } else {
+                unget_char(c);
             }
         } else if (c == '*') {
-            c = get_char();
-            if (c == '/') {
+            if ((c = get_char()) == '/') {
                 count--;
                 if (count == 0) {
                     if (store) {
-                        buf[len] = '\0';
+                        lexer->files->pos[-2] = '\0';
                     }
-                    return buf;
+                    return store ? buf : NULL;
                 }
-            }
-        }
-        if (c == '\n') {
-            source_stack->line++;
-        }
-        if (store) {
-            buf[len++] = c;
-            if (len == alloc - 1) {
-                alloc *= 2;
-                buf = realloc(buf, alloc);
+            } else {
+                unget_char(c);
             }
         }
     }
@@ -92,37 +181,25 @@ char *read_block_comment(int store) {
 }
 
 char *read_line_comment(int store) {
-    int alloc = 8;
-    int len = 0;
     char c;
-    char *buf = NULL;
-    if (store) {
-        buf = malloc(alloc);
-    }
+    char *buf = lexer->files->pos;
     while ((c = get_char()) != EOF) {
         if (c == '\n') {
-            source_stack->line++;
-            break;
-        }
-        if (store) {
-            buf[len++] = c;
-            if (len == alloc - 1) {
-                alloc *= 2;
-                buf = realloc(buf, alloc);
+            lexer->files->line++;
+            if (store) {
+                lexer->files->pos[-1] = '\0';
             }
+            break;
         }
     }
-    if (store) {
-        buf[len] = '\0';
-    }
-    return buf;
+    return store ? buf : NULL;
 }
 
 char read_non_space() {
     char c;
     while ((c = get_char()) != EOF) {
         if (c == '\n') {
-            source_stack->line++;
+            lexer->files->line++;
         }
         if (!(c == ' ' || c == '\t' || c == '\r')) {
             break;
@@ -136,7 +213,7 @@ int is_id_char(char c) {
 }
 
 Tok *make_token(int t) {
-    Tok *tok = malloc(sizeof(Tok));
+    Tok *tok = arena_new(Tok);
     tok->type = t;
     tok->line = lineno();
     if (t == TOK_NL) {
@@ -153,7 +230,7 @@ int expect_line_break() {
         c = get_char();
     }
     if (c == '\n') {
-        source_stack->line++;
+        lexer->files->line++;
         return 1;
     }
     unget_char(c);
@@ -174,10 +251,10 @@ int expect_line_break_or_semicolon() {
     return expect_line_break_or(';');
 }
 
-Tok *_next_token(int comment_ok) {
-    if (_last_token != NULL) {
-        Tok *t = _last_token;
-        _last_token = NULL;
+static Tok *read_token(int comment_ok) {
+    if (lexer->last_token != NULL) {
+        Tok *t = lexer->last_token;
+        lexer->last_token = NULL;
         return t;
     }
     char c = read_non_space();
@@ -192,7 +269,7 @@ Tok *_next_token(int comment_ok) {
                 t->line = start_line;
                 return t;
             } else {
-                return _next_token(0);
+                return read_token(0);
             }
         } else if (d == '*') {
             char *comm = read_block_comment(comment_ok);
@@ -203,7 +280,7 @@ Tok *_next_token(int comment_ok) {
                 t->line = start_line;
                 return t;
             } else {
-                return _next_token(0);
+                return read_token(0);
             }
         } else {
             unget_char(d);
@@ -268,26 +345,12 @@ Tok *_next_token(int comment_ok) {
         if (c == '{') {
             t = make_token(TOK_STARTBIND);
         } else if (isalpha(c) || c == '_') {
-            // TODO refactor this
             t = make_token(TOK_DIRECTIVE);
-            int alloc = 8;
-            char *buf = malloc(alloc);
-            buf[0] = c;
-            int len = 1;
-            for (;;) {
-                c = get_char();
-                if (!is_id_char(c)) {
-                    unget_char(c);
-                    break;
-                }
-                buf[len++] = c;
-                if (len == alloc - 1) {
-                    alloc *= 2;
-                    buf = realloc(buf, alloc);
-                }
-            }
-            buf[len] = 0;
-            t->sval = buf;
+            char *start = lexer->files->pos - 1;
+            while (is_id_char(c = get_char()));
+            unget_char(c);
+            terminate_here();
+            t->sval = intern_in_place(start);
         } else {
             error(lineno(), current_file_name(), "Unexpected character sequence '#%c'", c);
         }
@@ -447,6 +510,12 @@ Tok *_next_token(int comment_ok) {
     }
     return t;
 }
+Tok *_next_token(int comment_ok) {
+    timing_begin(PHASE_LEX, NULL);
+    Tok *t = read_token(comment_ok);
+    timing_end();
+    return t;
+}
 Tok *next_token() {
     Tok *t = _next_token(0);
     while (t && t->type == TOK_NL) {
@@ -481,10 +550,10 @@ Tok *try_eat_token(TokType t) {
 }
 
 void unget_token(Tok *tok) {
-    if (_last_token != NULL) {
+    if (lexer->last_token != NULL) {
         error(-1, "<internal>", "Cannot unget_token() twice in a row.");
     }
-    _last_token = tok;
+    lexer->last_token = tok;
 }
 
 double read_decimal(char c) {
@@ -593,16 +662,17 @@ Tok *read_number(char c) {
     return t;
 }
 
+// Escapes are decoded in place; the result is never longer than the source
+// text, so the terminating NUL lands at or before the closing quote.
 char *read_string() {
-    int alloc = 8;
-    char *buf = malloc(alloc);
-    int len = 0;
+    char *buf = lexer->files->pos;
+    char *out = buf;
     char c;
-    int start = source_stack->line;
+    int start = lexer->files->line;
     int escape = 0;
     while ((c = get_char()) != EOF) {
         if (c == '\"' && !escape) {
-            buf[len] = 0;
+            *out = '\0';
             return buf;
         }
         if (escape) {
@@ -651,11 +721,7 @@ char *read_string() {
             escape = 1;
             continue;
         }
-        buf[len++] = c;
-        if (len == alloc - 1) {
-            alloc *= 2;
-            buf = realloc(buf, alloc);
-        }
+        *out++ = c;
     }
     error(start, current_file_name(), "EOF encountered while reading string literal.");
     return NULL;
@@ -713,27 +779,14 @@ Tok *check_reserved(char *buf) {
 }
 
 Tok *read_identifier(char c) {
-    int alloc = 8;
-    char *buf = malloc(alloc);
-    buf[0] = c;
-    int len = 1;
-    for (;;) {
-        c = get_char();
-        if (!is_id_char(c)) {
-            unget_char(c);
-            break;
-        }
-        buf[len++] = c;
-        if (len == alloc - 1) {
-            alloc *= 2;
-            buf = realloc(buf, alloc);
-        }
-    }
-    buf[len] = 0;
+    char *buf = lexer->files->pos - 1;
+    while (is_id_char(c = get_char()));
+    unget_char(c);
+    terminate_here();
     Tok *t = check_reserved(buf);
     if (t == NULL) {
         t = make_token(TOK_ID);
-        t->sval = buf;
+        t->sval = intern_in_place(buf);
     }
     return t;
 }
@@ -1016,15 +1069,15 @@ int is_comparison(int op) {
 }
 
 int lineno() {
-    if (source_stack == NULL) {
+    if (lexer == NULL || lexer->files == NULL) {
         error(-1, "internal", "Trying to get line number with no source file");
     }
-    return source_stack->line;
+    return lexer->files->line;
 }
 
 char *current_file_name() {
-    if (source_stack == NULL) {
+    if (lexer == NULL || lexer->files == NULL) {
         error(-1, "internal", "No file on the source stack!");
     }
-    return source_stack->name;
+    return lexer->files->name;
 }
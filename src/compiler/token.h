@@ -116,8 +116,14 @@ const char *op_to_str(int op);
 int is_comparison(int op);
 int valid_unary_op(int op);
 
+typedef struct Lexer Lexer;
+
+Lexer *new_lexer();
+Lexer *use_lexer(Lexer *l);
+
 void push_file_source(char *name, FILE *f);
 void pop_file_source();
+void push_parsed_file_source(char *name, int line);
 
 Tok *expect(int type);
 Tok *expect_eol();
@@ -0,0 +1,147 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define MAX_DEPTH 256
+
+typedef struct Span {
+    const char *category;
+    const char *name;
+    char *detail;
+    double start;
+} Span;
+
+static FILE *out = NULL;
+static int events = 0;
+static int next_tid = 0;
+static double start_us;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread int tid = 0;
+static __thread Span stack[MAX_DEPTH];
+static __thread int depth = 0;
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void write_string(const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// called with the lock held
+static void begin_event() {
+    fprintf(out, events++ ? ",\n" : "[\n");
+}
+
+static void close_trace() {
+    pthread_mutex_lock(&lock);
+    if (out) {
+        if (!events) {
+            fprintf(out, "[");
+        }
+        fprintf(out, "\n]\n");
+        fclose(out);
+        out = NULL;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+int trace_open(char *path) {
+    out = fopen(path, "w");
+    if (!out) {
+        return 0;
+    }
+    start_us = now_us();
+    atexit(close_trace);
+    return 1;
+}
+
+int trace_enabled() {
+    return out != NULL;
+}
+
+// The first thread to trace is the one compiling; the rest load packages.
+static int thread_id() {
+    if (tid) {
+        return tid;
+    }
+    pthread_mutex_lock(&lock);
+    tid = ++next_tid;
+    begin_event();
+    fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            (int)getpid(), tid, tid == 1 ? "compiler" : "package loader");
+    pthread_mutex_unlock(&lock);
+    return tid;
+}
+
+void trace_begin(const char *category, const char *name, const char *detail) {
+    if (!out) {
+        return;
+    }
+    if (depth >= MAX_DEPTH) {
+        depth++;
+        return;
+    }
+    thread_id();
+    stack[depth++] = (Span){category, name, detail ? strdup(detail) : NULL, now_us()};
+}
+
+void trace_end() {
+    if (!out) {
+        return;
+    }
+    if (depth > MAX_DEPTH) {
+        depth--;
+        return;
+    }
+    Span *s = &stack[--depth];
+    double end = now_us();
+    pthread_mutex_lock(&lock);
+    if (out) {
+        begin_event();
+        fprintf(out, "{\"name\":");
+        write_string(s->name);
+        fprintf(out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                s->category, s->start - start_us, end - s->start, (int)getpid(), tid);
+        if (s->detail) {
+            fprintf(out, ",\"args\":{\"detail\":");
+            write_string(s->detail);
+            fprintf(out, "}");
+        }
+        fprintf(out, "}");
+    }
+    pthread_mutex_unlock(&lock);
+    free(s->detail);
+}
+
+int trace_depth() {
+    return depth;
+}
+
+void trace_unwind(int to) {
+    while (depth > to) {
+        depth--;
+        if (depth < MAX_DEPTH) {
+            free(stack[depth].detail);
+        }
+    }
+}
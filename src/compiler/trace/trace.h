@@ -0,0 +1,19 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Spans in the Chrome trace-event format, for -trace; the file opens in
+// chrome://tracing or ui.perfetto.dev. A span is written when it ends, so the
+// file is valid (if incomplete) even when compilation stops on an error.
+
+// Returns 0 if the file can't be written.
+int trace_open(char *path);
+int trace_enabled();
+// category and name must outlive the span; detail is copied, and may be NULL
+void trace_begin(const char *category, const char *name, const char *detail);
+void trace_end();
+// As with timing_depth and timing_unwind, for code that can longjmp out of
+// spans; the abandoned spans are dropped.
+int trace_depth();
+void trace_unwind(int depth);
+
+#endif
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "array/array.h"
@@ -10,6 +11,9 @@ int check_type(Type *a, Type *b) {
     if (a == NULL || b == NULL) {
         return 0;
     }
+    if (a == b) {
+        return 1;
+    }
     if (a->aka != NULL) {
         return check_type(a->aka, b);
     }
@@ -17,7 +21,7 @@ int check_type(Type *a, Type *b) {
         return check_type(a, b->aka);
     }
     if (a->name && b->name) {
-        if (strcmp(a->name, b->name)) {
+        if (a->name != b->name) {
             return 0;
         }
     }
@@ -60,11 +64,11 @@ int check_type(Type *a, Type *b) {
     if (ar == br) {
         if (a->name == NULL && b->name == NULL) {
             return 1;
-        } else if (a->name && b->name && !strcmp(a->name, b->name)) {
+        } else if (a->name && b->name && a->name == b->name) {
             return 1;
         }
         return 0;
-    } else if (a->name && b->name && !strcmp(a->name, b->name) && a->scope == b->scope) {
+    } else if (a->name && b->name && a->name == b->name && a->scope == b->scope) {
         return 1;
     }
     if ((a->name == NULL && b->name != NULL) || 
@@ -89,7 +93,7 @@ int check_type(Type *a, Type *b) {
             return 0;
         }
         for (int i = 0; i < array_len(ar->st.member_names); i++) {
-            if (strcmp(ar->st.member_names[i], br->st.member_names[i])) {
+            if (ar->st.member_names[i] != br->st.member_names[i]) {
                 return 0;
             }
             if (!check_type(ar->st.member_types[i], br->st.member_types[i])) {
@@ -133,6 +137,63 @@ int check_type(Type *a, Type *b) {
     return 0;
 }
 
+#define HASH_MIX(h, x) (((h) ^ (unsigned int)(x)) * 16777619u)
+
+// Structural hash that agrees with check_type: any two types check_type
+// considers equal hash the same. A named type hashes by its name, which
+// check_type requires to match and which doesn't change as the type gets
+// resolved, unless its definition is an unnamed type (a polymorph's type
+// parameter, say), which it is then equal to through their shared id.
+unsigned int type_hash(Type *t) {
+    while (t && t->aka) {
+        t = t->aka;
+    }
+    if (t == NULL) {
+        return 0;
+    }
+    if (t->name) {
+        TypeDef *def = find_type_definition(t);
+        if (def && def->type != t && !def->type->name) {
+            return type_hash(def->type);
+        }
+        return HASH_MIX(2166136261u, (uintptr_t)t->name >> 3);
+    }
+    ResolvedType *r = t->resolved;
+    if (r == NULL) {
+        return 1;
+    }
+    unsigned int h = HASH_MIX(2166136261u, r->comp);
+    switch (r->comp) {
+    case BASIC:
+    case ENUM:
+        return HASH_MIX(h, t->id);
+    case REF:
+        return HASH_MIX(h, type_hash(r->ref.inner));
+    case STATIC_ARRAY:
+        h = HASH_MIX(h, r->array.length);
+        // fallthrough
+    case ARRAY:
+        return HASH_MIX(h, type_hash(r->array.inner));
+    case STRUCT:
+        for (int i = 0; i < array_len(r->st.member_names); i++) {
+            h = HASH_MIX(h, (uintptr_t)r->st.member_names[i] >> 3);
+            h = HASH_MIX(h, type_hash(r->st.member_types[i]));
+        }
+        return h;
+    case FUNC:
+        h = HASH_MIX(h, r->fn.variadic);
+        for (int i = 0; i < array_len(r->fn.args); i++) {
+            h = HASH_MIX(h, type_hash(r->fn.args[i]));
+        }
+        for (int i = 0; i < array_len(r->fn.ret); i++) {
+            h = HASH_MIX(h, type_hash(r->fn.ret[i]));
+        }
+        return h;
+    default:
+        return h;
+    }
+}
+
 int can_cast(Type *from, Type *to) {
     if (is_any(to)) {
         return 1;
@@ -176,7 +237,7 @@ int can_cast(Type *from, Type *to) {
             if (!check_type(fr->st.member_types[i], tr->st.member_types[i])) {
                 return 0;
             }
-            if (strcmp(fr->st.member_names[i], tr->st.member_names[i])) {
+            if (fr->st.member_names[i] != tr->st.member_names[i]) {
                 return 0;
             }
         }
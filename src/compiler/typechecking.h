@@ -5,6 +5,7 @@
 //#include "types.h"
 
 int check_type(Type *a, Type *b);
+unsigned int type_hash(Type *t);
 int can_cast(Type *from, Type *to);
 Ast *any_cast(Scope *scope, Ast *ast);
 Ast *coerce_type_no_error(Scope *scope, Type *to, Ast *from);
@@ -5,8 +5,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "arena/arena.h"
 #include "array/array.h"
+#include "intern/intern.h"
 #include "ast.h"
+#include "package.h"
 #include "polymorph.h"
 #include "semantics.h"
 #include "typechecking.h"
@@ -15,6 +18,20 @@
 
 static int last_type_id = 0;
 
+static void assign_type_id(Type *t) {
+    if (id_log) {
+        array_push(id_log->types, t);
+        return;
+    }
+    t->id = last_type_id++;
+}
+
+void assign_type_ids(Type **types) {
+    for (int i = 0; i < array_len(types); i++) {
+        types[i]->id = last_type_id++;
+    }
+}
+
 typedef struct MethodList {
     Type *type;
     char *name;
@@ -31,7 +48,7 @@ Type *reify_struct(Scope *scope, Ast *ast, Type *type);
 
 static void _define_method(Scope *impl_scope, Type *t, Ast *decl) {
     MethodList *last = all_methods;
-    all_methods = calloc(sizeof(MethodList), 1);
+    all_methods = arena_new(MethodList);
     all_methods->type = t;
     all_methods->name = decl->fn_decl->var->name;
     all_methods->scope = impl_scope;
@@ -44,7 +61,7 @@ Ast *find_method(Type *t, char *name) {
     MethodList *found_poly = NULL;
     Type *matched_against = NULL;
     for (MethodList *list = all_methods; list != NULL; list = list->next) {
-        if (!strcmp(list->name, name)) {
+        if (list->name == name) {
             resolve_type(list->type);
             if (is_polydef(list->type)) {
                 Type *match_against = t;
@@ -108,7 +125,7 @@ Ast *find_method(Type *t, char *name) {
 Ast *define_method(Scope *impl_scope, Type *t, Ast *decl) {
     assert(decl->type == AST_FUNC_DECL);
     for (MethodList *list = all_methods; list != NULL; list = list->next) {
-        if (t->resolved && !strcmp(list->name, decl->fn_decl->var->name)) {
+        if (t->resolved && list->name == decl->fn_decl->var->name) {
             if (t->id == list->type->id || t->resolved == list->type->resolved) {
                 return list->decl;
             }
@@ -119,20 +136,20 @@ Ast *define_method(Scope *impl_scope, Type *t, Ast *decl) {
 }
 
 static ResolvedType *make_resolved(TypeComp comp) {
-    ResolvedType *r = calloc(sizeof(ResolvedType), 1);
+    ResolvedType *r = arena_new(ResolvedType);
     r->comp = comp;
     return r;
 }
 
 Type *make_primitive(int base, int size) {
-    TypeData *data = malloc(sizeof(TypeData));
+    TypeData *data = arena_new(TypeData);
     data->base = base;
     data->size = size;
 
-    Type *type = calloc(sizeof(Type), 1);
+    Type *type = arena_new(Type);
     type->resolved = make_resolved(BASIC);
     type->resolved->data = data;
-    type->id = last_type_id++;
+    assign_type_id(type);
     return type;
 }
 
@@ -175,13 +192,13 @@ Type *copy_type(Scope *scope, Type *t) {
     /*if (t->resolved && t->resolved->comp == BASIC) {*/
         /*return t;*/
     /*}*/
-    Type *type = calloc(sizeof(Type), 1);
+    Type *type = arena_new(Type);
     *type = *t;
     type->scope = scope;
     if (!type->resolved) {
         return type;
     }
-    type->resolved = calloc(sizeof(ResolvedType), 1);
+    type->resolved = arena_new(ResolvedType);
     *type->resolved = *t->resolved;
     ResolvedType *r = type->resolved;
     ResolvedType *cr = t->resolved;
@@ -218,8 +235,6 @@ Type *copy_type(Scope *scope, Type *t) {
         r->st.member_names = array_copy(cr->st.member_names);
         for (int i = 0; i < array_len(cr->st.member_types); i++) {
             r->st.member_types[i] = copy_type(scope, cr->st.member_types[i]);
-            r->st.member_names[i] = malloc(sizeof(char) * strlen(cr->st.member_names[i] + 1));
-            strcpy(r->st.member_names[i], cr->st.member_names[i]);
         }
         if (cr->st.generic) {
             r->st.arg_params = array_copy(cr->st.arg_params);
@@ -237,8 +252,6 @@ Type *copy_type(Scope *scope, Type *t) {
         r->en.member_values = array_copy(cr->en.member_values);
         for (int i = 0; i < array_len(cr->st.member_types); i++) {
             r->en.member_values[i] = cr->en.member_values[i];
-            r->en.member_names[i] = malloc(sizeof(char) * strlen(cr->en.member_names[i] + 1));
-            strcpy(r->st.member_names[i], cr->st.member_names[i]);
         }
         break;
     }
@@ -246,32 +259,32 @@ Type *copy_type(Scope *scope, Type *t) {
 }
 
 Type *make_type(Scope *scope, char *name) {
-    Type *type = calloc(sizeof(Type), 1);
-    type->name = name;
+    Type *type = arena_new(Type);
+    type->name = intern(name);
     type->scope = scope;
-    type->id = last_type_id++;
+    assign_type_id(type);
     return type;
 }
 
 Type *make_polydef(Scope *scope, char *name) {
-    Type *type = calloc(sizeof(Type), 1);
-    type->name = name;
+    Type *type = arena_new(Type);
+    type->name = intern(name);
     type->scope = scope;
     type->resolved = make_resolved(POLYDEF);
     return type;
 }
 
 Type *make_ref_type(Type *inner) {
-    Type *type = calloc(sizeof(Type), 1);
-    type->id = last_type_id++;
+    Type *type = arena_new(Type);
+    assign_type_id(type);
     type->resolved = make_resolved(REF);
     type->resolved->ref.inner = inner;
     return type;
 }
 
 Type *make_fn_type(Type **args, Type **ret, int variadic) {
-    Type *type = calloc(sizeof(Type), 1);
-    type->id = last_type_id++;
+    Type *type = arena_new(Type);
+    assign_type_id(type);
     type->resolved = make_resolved(FUNC);
     type->resolved->fn.args = args;
     type->resolved->fn.ret = ret;
@@ -280,8 +293,8 @@ Type *make_fn_type(Type **args, Type **ret, int variadic) {
 }
 
 Type *make_static_array_type(Type *inner, long length) {
-    Type *type = calloc(sizeof(Type), 1);
-    type->id = last_type_id++;
+    Type *type = arena_new(Type);
+    assign_type_id(type);
     type->resolved = make_resolved(STATIC_ARRAY);
     type->resolved->array.inner = inner;
     type->resolved->array.length = length;
@@ -289,8 +302,8 @@ Type *make_static_array_type(Type *inner, long length) {
 }
 
 Type *make_array_type(Type *inner) {
-    Type *type = calloc(sizeof(Type), 1);
-    type->id = last_type_id++;
+    Type *type = arena_new(Type);
+    assign_type_id(type);
     type->resolved = make_resolved(ARRAY);
     type->resolved->array.inner = inner;
     type->resolved->array.length = -1; // eh?
@@ -298,12 +311,15 @@ Type *make_array_type(Type *inner) {
 }
 
 Type *make_enum_type(Type *inner, char **member_names, long *member_values) {
-    Type *type = calloc(sizeof(Type), 1);
-    type->id = last_type_id++;
+    Type *type = arena_new(Type);
+    assign_type_id(type);
     type->resolved = make_resolved(ENUM);
     type->resolved->en.inner = inner;
     type->resolved->en.member_names = member_names;
     type->resolved->en.member_values = member_values;
+    for (int i = 0; i < array_len(member_names); i++) {
+        member_names[i] = intern(member_names[i]);
+    }
     return type;
 }
 
@@ -317,13 +333,16 @@ long enum_type_val(Type *t, int index) {
 }
 
 Type *make_struct_type(char **member_names, Type **member_types) {
-    Type *s = calloc(sizeof(Type), 1);
-    s->id = last_type_id++;
+    Type *s = arena_new(Type);
+    assign_type_id(s);
     s->resolved = make_resolved(STRUCT);
     s->resolved->st.generic_base = NULL;
     s->resolved->st.member_names = member_names;
     s->resolved->st.member_types = member_types;
     s->resolved->st.generic = 0;
+    for (int i = 0; i < array_len(member_names); i++) {
+        member_names[i] = intern(member_names[i]);
+    }
     return s;
 }
 
@@ -335,8 +354,8 @@ Type *make_generic_struct_type(char **member_names, Type **member_types, Type **
 }
 
 Type *make_params_type(Type *inner, Type **params) {
-    Type *t = calloc(sizeof(Type), 1);
-    t->id = last_type_id++;
+    Type *t = arena_new(Type);
+    assign_type_id(t);
     t->resolved = make_resolved(PARAMS);
     t->resolved->params.inner = inner;
     t->resolved->params.args = params;
@@ -344,11 +363,11 @@ Type *make_params_type(Type *inner, Type **params) {
 }
 
 Type *make_external_type(char *pkg, char *name) {
-    Type *t = calloc(sizeof(Type), 1);
-    t->id = last_type_id++;
-    t->name = name;
+    Type *t = arena_new(Type);
+    assign_type_id(t);
+    t->name = intern(name);
     t->resolved = make_resolved(EXTERNAL);
-    t->resolved->ext.pkg_name = pkg;
+    t->resolved->ext.pkg_name = intern(pkg);
     t->resolved->ext.type_name = name;
     return t;
 }
@@ -500,18 +519,11 @@ Type *resolve_type(Type *type) {
     if (is_polydef(type)) {
         return type;
     }
-    Type **used_types = all_used_types();
-    for (int i = 0; i < array_len(used_types); i++) {
-        if (check_type(used_types[i], type)) {
-            if (used_types[i]->resolved) {
-                type->resolved = used_types[i]->resolved;
-            } else {
-                assert(type->resolved);
-                used_types[i]->resolved = type->resolved;
-            }
-            type->id = used_types[i]->id;
-            return type;
-        }
+    Type *used = find_used_type(type);
+    if (used && used->resolved) {
+        type->resolved = used->resolved;
+        type->id = used->id;
+        return type;
     }
     // find_type_or_polymorph should take care of this!
     assert(type->resolved->comp != EXTERNAL);
@@ -833,7 +845,7 @@ Type *replace_type_by_name(Type *base, char *from_name, Type *to) {
         break;
     }
     if (changed) {
-        base->id = last_type_id++;
+        assign_type_id(base);
         register_type(base);
     }
     return base;
@@ -896,6 +908,7 @@ static Type *fntype_type = NULL;
 static int fntype_type_id;
 static Type *any_type = NULL;
 static int any_type_id;
+static Type *string_builder_type = NULL;
 
 int is_any(Type *t) {
     return t->id == any_type_id;
@@ -907,6 +920,9 @@ Type *get_any_type() {
 int get_any_type_id() {
     return any_type_id;
 }
+Type *get_string_builder_type() {
+    return string_builder_type;
+}
 int get_typeinfo_type_id() {
     return typeinfo_type_id;
 }
@@ -1229,7 +1245,7 @@ void init_types(Scope *scope) {
     bool_type = define_type(scope, "bool", make_primitive(BOOL_T, 1), NULL);
     bool_type_id = bool_type->id;
 
-    string_type = define_type(scope, "string", make_primitive(STRING_T, 16), NULL);
+    string_type = define_type(scope, "string", make_primitive(STRING_T, 24), NULL);
     string_type_id = string_type->id;
 
     char **member_names = NULL;
@@ -1407,5 +1423,12 @@ void init_types(Scope *scope) {
     any_type = define_type(scope, "Any", make_struct_type(member_names, member_types), NULL);
     any_type_id = any_type->id;
 
+    // grown in place by the sb_* builtins, see prelude.c
+    member_names = NULL;
+    array_push(member_names, "buf");
+    member_types = NULL;
+    array_push(member_types, string_type);
+    string_builder_type = define_type(scope, "StringBuilder", make_struct_type(member_names, member_types), NULL);
+
     types_initialized = 1;
 }
@@ -41,6 +41,7 @@ Ast *define_method(Scope *impl_scope, Type *t, Ast *decl);
 
 Type *copy_type(Scope *scope, Type *t);
 Type *make_primitive(int base, int size);
+void assign_type_ids(Type **types);
 Type *make_type(Scope *scope, char *name);
 Type *make_polydef(Scope *scope, char *name);
 Type *make_poly(Scope *scope, char *name, int id);
@@ -66,6 +67,7 @@ Type *replace_type_by_name(Type *base, char *from_name, Type *to);
 
 int get_any_type_id();
 Type *get_any_type();
+Type *get_string_builder_type();
 int get_typeinfo_type_id();
 int get_basetype_id(TypeComp c);
 int get_numtype_type_id();
@@ -5,52 +5,16 @@
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <setjmp.h>
 
 #include "util.h"
 
-void print_quoted_string(FILE *f, char *val) {
-    for (char *c = val; *c; c++) {
-        switch (*c) {
-        case 0x27:
-            fprintf(f, "\\\'");
-            break;
-        case 0x22:
-            fprintf(f, "\\\"");
-            break;
-        case 0x3f:
-            fprintf(f, "\\?");
-            break;
-        case 0x5c:
-            fprintf(f, "\\\\");
-            break;
-        case 0x07:
-            fprintf(f, "\\a");
-            break;
-        case 0x08:
-            fprintf(f, "\\b");
-            break;
-        case 0x0c:
-            fprintf(f, "\\f");
-            break;
-        case 0x0a:
-            fprintf(f, "\\n");
-            break;
-        case 0x0d:
-            fprintf(f, "\\r");
-            break;
-        case 0x09:
-            fprintf(f, "\\t");
-            break;
-        case 0x0b:
-            fprintf(f, "\\v");
-            break;
-        default:
-            fprintf(f, "%c", *c);
-        }
-    }
-}
+__thread jmp_buf *error_trap = NULL;
 
 void error(int line, char *file, char *fmt, ...) {
+    if (error_trap) {
+        longjmp(*error_trap, 1);
+    }
     fprintf(stderr, "%s:%d: ", file, line);
     va_list args;
     va_start(args, fmt);
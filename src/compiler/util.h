@@ -1,9 +1,13 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <setjmp.h>
 #include <stdio.h>
 
-void print_quoted_string(FILE *f, char *val);
+// When set, error() jumps here instead of reporting and exiting. Used by
+// worker threads, whose errors are reported when the work is redone serially.
+extern __thread jmp_buf *error_trap;
+
 void error(int line, char *file, char *fmt, ...);
 int escaped_strlen(const char *str);
 void errlog(char *fmt, ...);
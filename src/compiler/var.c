@@ -3,7 +3,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena/arena.h"
 #include "array/array.h"
+#include "intern/intern.h"
+#include "package.h"
 #include "var.h"
 
 static int last_var_id = 0;
@@ -13,21 +16,27 @@ int new_var_id() {
 }
 
 Var *make_var(char *name, Type *type) {
-    Var *var = calloc(sizeof(Var), 1);
+    Var *var = arena_new(Var);
+    var->name = intern(name);
 
-    var->name = malloc(strlen(name)+1);
-    strcpy(var->name, name);
-
-    var->id = new_var_id();
+    if (id_log) {
+        array_push(id_log->vars, var);
+    } else {
+        var->id = new_var_id();
+    }
     var->type = type;
     return var;
 }
 
+void assign_var_ids(Var **vars) {
+    for (int i = 0; i < array_len(vars); i++) {
+        vars[i]->id = new_var_id();
+    }
+}
+
 Var *copy_var(Scope *scope, Var *v) {
-    Var *var = malloc(sizeof(Var));
+    Var *var = arena_new(Var);
     *var = *v;
-    var->name = malloc(strlen(v->name)+1);
-    strcpy(var->name, v->name); // just in case
     if (v->type != NULL) {
         var->type = copy_type(scope, v->type);
     }
@@ -51,6 +60,7 @@ void init_struct_var(Var *var) {
         member_name[l] = 0;
 
         Var *v = make_var(member_name, r->st.member_types[i]); // TODO
+        free(member_name);
         v->initialized = 1; // maybe wrong?
         array_push(var->members, v);
     }
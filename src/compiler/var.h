@@ -5,6 +5,7 @@
 #include "types.h"
 
 Var *make_var(char *name, Type *type);
+void assign_var_ids(Var **vars);
 Var *copy_var(struct Scope *scope, Var *v);
 void init_struct_var(Var *var);
 
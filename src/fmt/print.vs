@@ -56,19 +56,19 @@ fn numFormatArgs(fmt: string) -> int {
 }
 
 fn uint_to_binary(x: uint, digits: uint) -> string {
-    s: string;
+    b: StringBuilder;
 
-    c: int;
+    c := digits;
 
-    while c < digits {
+    while c > 0 {
+        c -= 1;
         if ((1 << c) & x) != 0 {
-            s = "1" + s;
+            sb_append_byte(&b, "1");
         } else {
-            s = "0" + s;
+            sb_append_byte(&b, "0");
         }
-        c += 1;
     }
-    return s;
+    return sb_string(&b);
 }
 
 fn float64_to_string(f: float64) -> string {
@@ -273,7 +273,9 @@ fn size_of_type(t: &Type) -> int {
     use BaseType;
 
     bt := t.base;
-    if bt == STRING || bt == ANY {
+    if bt == STRING {
+        return 24;
+    } else if bt == ANY {
         return 16;
     } else if bt == BOOL {
         return 1;
@@ -316,12 +318,12 @@ fn any_repr(a: Any) -> string {
 }
 
 fn sprintf(fmt: string, args: Any...) -> string {
-    out: string;
+    out: StringBuilder;
 
     expected := numFormatArgs(fmt);
     if expected != args.length {
         os.write(os.Stderr, "Format string expects " + itoa(expected) + " args but received " + itoa(args.length) + ".\n");
-        return out;
+        return "";
     }
 
     i := 0;
@@ -332,21 +334,21 @@ fn sprintf(fmt: string, args: Any...) -> string {
         c := fmt[i];
         if c == "v" {
             if mod_last {
-                out += any_to_string(args[n]);
+                sb_append(&out, any_to_string(args[n]));
                 n += 1;
             }
             mod_last = false;
         } else if c == "%" {
             if mod_last {
-                out += "%";
+                sb_append_byte(&out, c);
             }
             mod_last = !mod_last;
         } else {
-            out += fmt[i:1];
+            sb_append_byte(&out, c);
         }
         i += 1;
     }
-    return out;
+    return sb_string(&out);
 }
 
 fn printf(fmt:string, args:Any...) {
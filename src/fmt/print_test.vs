@@ -22,5 +22,6 @@ fn main() -> int {
     expected := "static array: [2]string::{\"101\", \"202\"} &[2]string\n";
     assert(sprintf("static array: %v %v\n", x1, &x1) == expected);
     assert(sprintf("%v%%", 20) == "20%");
+    assert(uint_to_binary(5, 4) == "0101");
     return 0;
 }
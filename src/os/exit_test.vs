@@ -1,3 +1,4 @@
+// expect-exit: 1
 #import "os"
 #import "fmt"
 
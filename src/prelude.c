@@ -15,105 +15,161 @@
 
 typedef void * fn_type;
 typedef void * ptr_type;
+// Strings of up to STRING_INLINE bytes are kept in the struct itself (small),
+// longer ones on the heap (bytes); the length says which. Both are
+// NUL-terminated, except for views of long strings (see string_view).
+// literal marks a string literal's static data, which is never freed and is
+// shared by copies.
+#define STRING_INLINE 15
 struct string_type {
     int length;
-    char *bytes;
+    char literal;
+    union {
+        char *bytes;
+        char small[STRING_INLINE + 1];
+    };
 };
 struct array_type {
     long length;
     void *data;
 };
-// TODO double-check nulls are in the right spot
-struct string_type init_string(const char *str, int l) {
-    struct string_type v;
-    if (l <= 0) {
-        return (struct string_type){.bytes=NULL, .length=0};
+struct string_type init_string(const char *str, int l);
+struct string_type copy_string(struct string_type str);
+struct string_type append_string(struct string_type lhs, struct string_type rhs);
+struct string_type append_string_lit(struct string_type lhs, char *bytes, int length);
+struct string_type string_slice(struct string_type str, int offset, int len);
+struct string_type concat_strings(int n, struct string_type *parts);
+struct array_type allocate_array(long length, size_t el_size);
+void _vs_assert(int a);
+void _vs_println(struct string_type str);
+void _vs_print_str(struct string_type str);
+struct string_type _vs_utoa(uint64_t x);
+struct string_type _vs_itoa(int64_t x);
+void _vs_print_buf(uint8_t *buf);
+void _vs_sb_append(void *b, struct string_type str);
+void _vs_sb_append_byte(void *b, uint8_t c);
+struct string_type _vs_sb_string(void *b);
+// small enough to inline, so these stay with the declarations
+static inline char *string_bytes(struct string_type *str) {
+    return str->length <= STRING_INLINE ? str->small : str->bytes;
+}
+static inline void free_string(struct string_type str) {
+    if (str.length > STRING_INLINE && !str.literal) {
+        free(str.bytes);
     }
-    v.length = l;
-    v.bytes = malloc(l+1);
-    strncpy(v.bytes, str, l+1);
-    return v;
-}
-struct string_type copy_string(struct string_type str) {
-    struct string_type v;
-    int l = str.length;
-    if (l <= 0) {
-        return (struct string_type){.bytes=NULL, .length=0};
-    }
-    v.length = l;
-    v.bytes = malloc(l+1);
-    strncpy(v.bytes, str.bytes, l+1);
-    return v;
 }
-struct string_type append_string(struct string_type lhs, struct string_type rhs) {
-    struct string_type v;
-    int l = lhs.length + rhs.length;
-    v.length = l;
-    v.bytes = malloc(l+1);
-    strncpy(v.bytes, lhs.bytes, lhs.length);
-    strncpy(v.bytes + lhs.length, rhs.bytes, rhs.length);
-    v.bytes[l] = 0;
-    return v;
+static inline int streq_lit(struct string_type left, char *right, int n) {
+    return left.length == n && !memcmp(string_bytes(&left), right, n);
 }
-struct string_type append_string_lit(struct string_type lhs, char *bytes, int length) {
-    struct string_type v;
-    int l = lhs.length + length;
-    v.length = l;
-    v.bytes = malloc(l+1);
-    strncpy(v.bytes, lhs.bytes, lhs.length);
-    strncpy(v.bytes + lhs.length, bytes, length);
-    v.bytes[l] = 0;
-    return v;
+static inline int streq(struct string_type left, struct string_type right) {
+    return left.length == right.length &&
+        !memcmp(string_bytes(&left), string_bytes(&right), left.length);
 }
-int streq_lit(struct string_type left, char *right, int n) {
-    if (left.length != n) {
-        return 0;
-    }
-    for (int i = 0; i < n; i++) {
-        if (left.bytes[i] != right[i]) {
-            return 0;
-        }
-    }
-    return 1;
+
+// str must outlive the array, since a short string's bytes are in str itself
+static inline struct array_type string_as_array(struct string_type *str) {
+    struct array_type arr = {.data=string_bytes(str), .length=str->length};
+    return arr;
 }
-int streq(struct string_type left, struct string_type right) {
-    if (left.length != right.length) {
-        return 0;
-    }
-    for (int i = 0; i < left.length; i++) {
-        if (left.bytes[i] != right.bytes[i]) {
-            return 0;
-        }
+
+static inline struct array_type array_slice(struct array_type arr, long offset, size_t el_size, long length) {
+    if (offset != 0) {
+        arr.data = (((char *)arr.data) + (offset * el_size));
     }
-    return 1;
+    arr.length = length == -1 ? arr.length - offset : length;
+    return arr;
 }
 
-struct string_type string_slice(struct string_type str, int offset, int len) {
-    if (len == -1) {
-        len = str.length - offset;
-    } else if (offset + len > str.length) {
+// a slice sharing the string's bytes, so not NUL-terminated, if it's too long
+// to be kept inline; string_slice copies it
+static inline struct string_type string_view(struct string_type str, int offset, int len) {
+    if (len == -1 || offset + len > str.length) {
         len = str.length - offset;
     }
     if (len <= 0) {
-        return (struct string_type){.bytes=NULL, .length=0};
+        return (struct string_type){0};
+    }
+    if (str.length <= STRING_INLINE) {
+        memmove(str.small, str.small + offset, len);
+        str.small[len] = 0;
+    } else if (len <= STRING_INLINE) {
+        struct string_type v = {.length=len};
+        memcpy(v.small, str.bytes + offset, len);
+        return v;
+    } else {
+        // a view that stops short of a literal's end isn't NUL-terminated, so
+        // it can't be shared as one
+        if (offset + len < str.length) {
+            str.literal = 0;
+        }
+        str.bytes += offset;
     }
-
-    str.bytes += offset;
     str.length = len;
-    return copy_string(str);
+    return str;
 }
 
-struct array_type string_as_array(struct string_type str) {
-    struct array_type arr = {.data=str.bytes, .length=str.length};
-    return arr;
+static inline unsigned char _vs_validptr(ptr_type p) {
+    return (p != NULL);
+}
+// end of declarations: everything above is included in generated code (with
+// -split, in the shared header); the runtime below is either pasted after it or,
+// with -runtime-lib, linked from bin/libverse_rt.a
+// Sets v's length to l and returns where its bytes go: inline if they fit,
+// otherwise a new heap buffer. The caller writes the bytes and the NUL.
+static char *alloc_string(struct string_type *v, int l) {
+    v->length = l;
+    if (l <= STRING_INLINE) {
+        return v->small;
+    }
+    v->bytes = malloc(l+1);
+    return v->bytes;
+}
+struct string_type init_string(const char *str, int l) {
+    struct string_type v = {0};
+    if (l <= 0) {
+        return v;
+    }
+    char *b = alloc_string(&v, l);
+    memcpy(b, str, l);
+    b[l] = 0;
+    return v;
+}
+struct string_type copy_string(struct string_type str) {
+    if (str.literal) {
+        return str;
+    }
+    return init_string(string_bytes(&str), str.length);
+}
+struct string_type append_string(struct string_type lhs, struct string_type rhs) {
+    return append_string_lit(lhs, string_bytes(&rhs), rhs.length);
+}
+struct string_type append_string_lit(struct string_type lhs, char *bytes, int length) {
+    struct string_type v = {0};
+    int l = lhs.length + length;
+    char *b = alloc_string(&v, l);
+    memcpy(b, string_bytes(&lhs), lhs.length);
+    memcpy(b + lhs.length, bytes, length);
+    b[l] = 0;
+    return v;
 }
 
-struct array_type array_slice(struct array_type arr, long offset, size_t el_size, long length) {
-    if (offset != 0) {
-        arr.data = (((char *)arr.data) + (offset * el_size));
+struct string_type string_slice(struct string_type str, int offset, int len) {
+    return copy_string(string_view(str, offset, len));
+}
+// a + b + c + ... in one allocation
+struct string_type concat_strings(int n, struct string_type *parts) {
+    int l = 0;
+    for (int i = 0; i < n; i++) {
+        l += parts[i].length;
     }
-    arr.length = length == -1 ? arr.length - offset : length;
-    return arr;
+    struct string_type v = {0};
+    char *b = alloc_string(&v, l);
+    for (int i = 0; i < n; i++) {
+        memcpy(b, string_bytes(&parts[i]), parts[i].length);
+        b += parts[i].length;
+    }
+    *b = 0;
+    return v;
 }
 
 struct array_type allocate_array(long length, size_t el_size) {
@@ -131,34 +187,63 @@ void _vs_assert(int a) {
     assert(a);
 }
 void _vs_println(struct string_type str) {
-    printf("%s\n", str.bytes);
-    free(str.bytes);
-    /*free(str);*/
-}
-unsigned char _vs_validptr(ptr_type p) {
-    return (p != NULL);
+    printf("%.*s\n", str.length, string_bytes(&str));
+    free_string(str);
 }
 void _vs_print_str(struct string_type str) {
-    printf("%s", str.bytes);
-    free(str.bytes);
-    /*free(str);*/
+    printf("%.*s", str.length, string_bytes(&str));
+    free_string(str);
 }
+// at most 20 digits and a sign, so most fit inline
 struct string_type _vs_utoa(uint64_t x) {
-    struct string_type v;
-    int l = snprintf(NULL, 0, "%lu", x);
-    v.bytes = malloc(l+1);
-    snprintf(v.bytes, l+1, "%lu", x);
-    v.length = strlen(v.bytes);
-    return v;
+    char buf[24];
+    return init_string(buf, snprintf(buf, sizeof(buf), "%lu", x));
 }
 struct string_type _vs_itoa(int64_t x) {
-    struct string_type v;
-    int l = snprintf(NULL, 0, "%ld", x);
-    v.bytes = malloc(l+1);
-    snprintf(v.bytes, l+1, "%ld", x);
-    v.length = strlen(v.bytes);
-    return v;
+    char buf[24];
+    return init_string(buf, snprintf(buf, sizeof(buf), "%ld", x));
 }
 void _vs_print_buf(uint8_t *buf) {
     fputs(buf, stdout);
 }
+
+// A StringBuilder is a struct holding just the string built so far (buf), so
+// these take it as a pointer to that string. Its heap buffer is always asked
+// for in a power of two, so realloc only moves it when the length crosses one
+// and appends are amortized O(1); since no capacity is kept, a builder that's
+// copied or freed like any other struct stays valid.
+static void sb_write(struct string_type *buf, const char *bytes, int n) {
+    int l = buf->length + n;
+    if (l > STRING_INLINE) {
+        size_t cap = 32;
+        while (cap < (size_t)l + 1) {
+            cap <<= 1;
+        }
+        if (buf->length > STRING_INLINE && !buf->literal) {
+            buf->bytes = realloc(buf->bytes, cap);
+        } else {
+            char *heap = malloc(cap);
+            memcpy(heap, string_bytes(buf), buf->length);
+            buf->bytes = heap;
+            buf->literal = 0;
+        }
+    }
+    char *b = l > STRING_INLINE ? buf->bytes : buf->small;
+    memcpy(b + buf->length, bytes, n);
+    b[l] = 0;
+    buf->length = l;
+}
+void _vs_sb_append(void *b, struct string_type str) {
+    sb_write(b, string_bytes(&str), str.length);
+    free_string(str);
+}
+void _vs_sb_append_byte(void *b, uint8_t c) {
+    sb_write(b, (char *)&c, 1);
+}
+// hands over the string, leaving the builder empty
+struct string_type _vs_sb_string(void *b) {
+    struct string_type *buf = b;
+    struct string_type v = *buf;
+    *buf = (struct string_type){0};
+    return v;
+}
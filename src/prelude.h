@@ -0,0 +1,4 @@
+const char prelude[] = {
+#include "prelude.bin"
+};
+const int prelude_length = 8340;
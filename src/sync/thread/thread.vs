@@ -69,7 +69,9 @@ type Thread: struct {
 
 extern fn clone(fn(), #autocast ptr, #autocast ptr, #autocast ptr);
 
-STACK_SIZE := 4096;
+// enough for a few calls through fmt, whose string temporaries are all on the
+// stack
+STACK_SIZE := 16384;
 
 fn New(start: fn()) -> &Thread {
     use syscall;
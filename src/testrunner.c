@@ -0,0 +1,357 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Compiles, links and runs verse test programs concurrently, the way the
+// verse script would, and reports per-phase timings and the slowest tests.
+// A test passes if every phase exits 0, or if the program exits with the
+// status named by an "// expect-exit: N" comment in its source. A test with
+// an "// expect-stats: ..." comment is compiled with -stats, and the rest of
+// that line has to appear in what the compiler reports.
+//
+// usage: bin/testrunner [-j jobs] [-slowest n] [-timeout secs] file.vs...
+
+extern char **environ;
+
+typedef enum {
+    COMPILE,
+    LINK,
+    RUN,
+    NUM_PHASES
+} Phase;
+
+static const char *phase_names[NUM_PHASES] = {"compile", "link", "run"};
+
+typedef struct Test {
+    char *file;
+    double times[NUM_PHASES];
+    double total;
+    int failed;
+    Phase failed_phase;
+    int status;
+    char *output; // stderr of the failing phase
+} Test;
+
+static Test *tests;
+static int num_tests;
+static int next_test = 0;
+static int done_tests = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *tmp_dir;
+static char *cc = "gcc";
+static glob_t asm_files;
+static int timeout_secs = 60;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return strdup("");
+    }
+    size_t cap = 4096, len = 0, n;
+    char *buf = malloc(cap);
+    while ((n = fread(buf + len, 1, cap - len - 1, f)) > 0) {
+        len += n;
+        if (len == cap - 1) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    buf[len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static int expected_exit(const char *file) {
+    char *src = read_file(file);
+    char *marker = strstr(src, "// expect-exit:");
+    int status = marker ? atoi(marker + strlen("// expect-exit:")) : 0;
+    free(src);
+    return status;
+}
+
+// Runs argv with stdout going to out (or /dev/null) and stderr to err,
+// killing it after timeout seconds if timeout > 0. Returns its exit status,
+// or 128 + the signal that ended it.
+static int run(char **argv, const char *out, const char *err, int timeout) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 1, out ? out : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_addopen(&actions, 2, err, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    pid_t pid;
+    int rc = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        FILE *f = fopen(err, "w");
+        if (f) {
+            fprintf(f, "could not run %s: %s\n", argv[0], strerror(rc));
+            fclose(f);
+        }
+        return 127;
+    }
+    int status = 0;
+    if (timeout > 0) {
+        double deadline = now() + timeout;
+        while (waitpid(pid, &status, WNOHANG) == 0) {
+            if (now() > deadline) {
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                FILE *f = fopen(err, "a");
+                if (f) {
+                    fprintf(f, "timed out after %ds\n", timeout);
+                    fclose(f);
+                }
+                break;
+            }
+            struct timespec ts = {0, 5 * 1000 * 1000};
+            nanosleep(&ts, NULL);
+        }
+    } else {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+// Returns the text following an "// expect-stats:" comment up to the end of
+// its line, or NULL if the source has none.
+static char *expected_stats(const char *file) {
+    char *src = read_file(file);
+    char *marker = strstr(src, "// expect-stats:");
+    char *expect = NULL;
+    if (marker) {
+        marker += strlen("// expect-stats:");
+        while (*marker == ' ') {
+            marker++;
+        }
+        expect = strndup(marker, strcspn(marker, "\n"));
+    }
+    free(src);
+    return expect;
+}
+
+static void fail(Test *t, Phase phase, int status, const char *err) {
+    t->failed = 1;
+    t->failed_phase = phase;
+    t->status = status;
+    t->output = read_file(err);
+}
+
+static void run_test(Test *t, int index) {
+    char base[4096];
+    snprintf(base, sizeof(base), "%s/%d", tmp_dir, index);
+    char c_file[4200], libs_file[4200], exe[4200], err[4200];
+    snprintf(c_file, sizeof(c_file), "%s.c", base);
+    snprintf(libs_file, sizeof(libs_file), "%s.libs", base);
+    snprintf(exe, sizeof(exe), "%s.out", base);
+    snprintf(err, sizeof(err), "%s.err", base);
+
+    char *stats = expected_stats(t->file);
+    double start = now();
+    char *compile_argv[] = {"./bin/compiler", "-o", c_file, "-emit-libs", libs_file, t->file,
+        stats ? "-stats" : NULL, NULL};
+    int status = run(compile_argv, NULL, err, 0);
+    t->times[COMPILE] = now() - start;
+    if (status != 0) {
+        free(stats);
+        fail(t, COMPILE, status, err);
+        goto done;
+    }
+    if (stats) {
+        char *reported = read_file(err);
+        int found = strstr(reported, stats) != NULL;
+        if (!found) {
+            FILE *f = fopen(err, "a");
+            if (f) {
+                fprintf(f, "expected stats \"%s\"\n", stats);
+                fclose(f);
+            }
+        }
+        free(reported);
+        free(stats);
+        if (!found) {
+            fail(t, COMPILE, 0, err);
+            goto done;
+        }
+    }
+
+    char *libs = read_file(libs_file);
+    char **link_argv = NULL;
+    int n = 0;
+    link_argv = malloc(sizeof(char *) * (asm_files.gl_pathc + strlen(libs) + 10));
+    link_argv[n++] = cc;
+    for (size_t i = 0; i < asm_files.gl_pathc; i++) {
+        link_argv[n++] = asm_files.gl_pathv[i];
+    }
+    link_argv[n++] = c_file;
+    link_argv[n++] = "-o";
+    link_argv[n++] = exe;
+    link_argv[n++] = "-g";
+    link_argv[n++] = "-std=c99";
+    char *save = NULL;
+    for (char *lib = strtok_r(libs, " \n", &save); lib; lib = strtok_r(NULL, " \n", &save)) {
+        link_argv[n++] = lib;
+    }
+    link_argv[n] = NULL;
+    start = now();
+    status = run(link_argv, NULL, err, 0);
+    t->times[LINK] = now() - start;
+    free(link_argv);
+    free(libs);
+    if (status != 0) {
+        fail(t, LINK, status, err);
+        goto done;
+    }
+
+    char *run_argv[] = {exe, NULL};
+    start = now();
+    status = run(run_argv, NULL, err, timeout_secs);
+    t->times[RUN] = now() - start;
+    if (status != expected_exit(t->file)) {
+        fail(t, RUN, status, err);
+    }
+
+done:
+    for (int i = 0; i < NUM_PHASES; i++) {
+        t->total += t->times[i];
+    }
+    unlink(c_file);
+    unlink(libs_file);
+    unlink(exe);
+    unlink(err);
+}
+
+static void *worker(void *arg) {
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        int i = next_test++;
+        pthread_mutex_unlock(&lock);
+        if (i >= num_tests) {
+            return NULL;
+        }
+        Test *t = &tests[i];
+        run_test(t, i);
+
+        pthread_mutex_lock(&lock);
+        done_tests++;
+        if (t->failed) {
+            printf("[%d/%d] FAIL %s (%s, exit %d)\n", done_tests, num_tests, t->file,
+                    phase_names[t->failed_phase], t->status);
+        } else {
+            printf("[%d/%d] ok   %s (%.2fs)\n", done_tests, num_tests, t->file, t->total);
+        }
+        fflush(stdout);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static int by_total_desc(const void *a, const void *b) {
+    double d = ((Test *)b)->total - ((Test *)a)->total;
+    return (d > 0) - (d < 0);
+}
+
+static void usage(char *bin) {
+    fprintf(stderr, "Usage:\n\t%s [-j jobs] [-slowest n] [-timeout secs] file.vs...\n", bin);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int slowest = 5;
+    char **files = malloc(sizeof(char *) * argc);
+    num_tests = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-slowest") && i + 1 < argc) {
+            slowest = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-timeout") && i + 1 < argc) {
+            timeout_secs = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            files[num_tests++] = argv[i];
+        }
+    }
+    if (num_tests == 0) {
+        usage(argv[0]);
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    if (getenv("CC")) {
+        cc = getenv("CC");
+    }
+    glob("src/*/*.S", 0, NULL, &asm_files);
+
+    char tmpl[] = "/tmp/verse-test-XXXXXX";
+    tmp_dir = mkdtemp(tmpl);
+    if (!tmp_dir) {
+        fprintf(stderr, "Could not create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+
+    tests = calloc(num_tests, sizeof(Test));
+    for (int i = 0; i < num_tests; i++) {
+        tests[i].file = files[i];
+    }
+
+    double start = now();
+    pthread_t *threads = malloc(sizeof(pthread_t) * jobs);
+    for (int i = 0; i < jobs; i++) {
+        pthread_create(&threads[i], NULL, worker, NULL);
+    }
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now() - start;
+    rmdir(tmp_dir);
+
+    int failed = 0;
+    double phase_totals[NUM_PHASES] = {0};
+    for (int i = 0; i < num_tests; i++) {
+        Test *t = &tests[i];
+        for (int j = 0; j < NUM_PHASES; j++) {
+            phase_totals[j] += t->times[j];
+        }
+        if (t->failed) {
+            failed++;
+            printf("\n--- %s: %s failed with exit %d\n%s", t->file,
+                    phase_names[t->failed_phase], t->status, t->output);
+        }
+    }
+
+    qsort(tests, num_tests, sizeof(Test), by_total_desc);
+    if (slowest > num_tests) {
+        slowest = num_tests;
+    }
+    printf("\nslowest:\n");
+    for (int i = 0; i < slowest; i++) {
+        Test *t = &tests[i];
+        printf("  %6.2fs  %-40s compile %.2fs  link %.2fs  run %.2fs\n", t->total, t->file,
+                t->times[COMPILE], t->times[LINK], t->times[RUN]);
+    }
+    printf("\n%d passed, %d failed in %.2fs on %d jobs (compile %.2fs, link %.2fs, run %.2fs)\n",
+            num_tests - failed, failed, elapsed, jobs,
+            phase_totals[COMPILE], phase_totals[LINK], phase_totals[RUN]);
+    return failed ? 1 : 0;
+}
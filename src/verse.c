@@ -1,17 +1,26 @@
+#include <errno.h>
+#include <glob.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-#include <sys/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "compiler/array/array.h"
 #include "compiler/ast.h"
+#include "compiler/build/build.h"
 #include "compiler/codegen.h"
 #include "compiler/find_libs.h"
 #include "compiler/parse.h"
 #include "compiler/package.h"
+#include "compiler/polymorph.h"
 #include "compiler/semantics.h"
+#include "compiler/timing/timing.h"
+#include "compiler/trace/trace.h"
+#include "compiler/serve/serve.h"
+#include "compiler/token.h"
 #include "compiler/types.h"
 #include "compiler/util.h"
 #include "compiler/var.h"
@@ -33,8 +42,20 @@ struct flag_set {
             struct flag help_flag;
             struct flag output_flag;
             struct flag libs_flag;
+            struct flag stats_flag;
+            struct flag jobs_flag;
+            struct flag emit_libs_flag;
+            struct flag verbose_flag;
+            struct flag split_flag;
+            struct flag serve_flag;
+            struct flag connect_flag;
+            struct flag profile_flag;
+            struct flag build_flag;
+            struct flag runtime_lib_flag;
+            struct flag time_report_flag;
+            struct flag trace_flag;
         };
-        struct flag set[3];
+        struct flag set[15];
     };
 };
 
@@ -102,60 +123,460 @@ char **parse_flags_get_args(struct flag_set *flags, int argc, char **argv) {
     return args;
 }
 
+// Set by -runtime-lib: the output only declares the runtime, which is linked
+// from bin/libverse_rt.a instead.
+static int runtime_lib = 0;
+
+// Returns the length of the part of the prelude that every output includes;
+// the runtime follows it.
+int prelude_decls_length() {
+    char *text = strndup(prelude, prelude_length);
+    char *decls_end = strstr(text, "// end of declarations");
+    assert(decls_end);
+    decls_end = strchr(decls_end, '\n') + 1;
+    int n = decls_end - text;
+    free(text);
+    return n;
+}
+
+void print_libs(FILE *f) {
+    char *sep = "";
+    if (runtime_lib) {
+        char *root = root_from_binary();
+        fprintf(f, "%sbin/libverse_rt.a", root);
+        free(root);
+        sep = " ";
+    }
+    LibEntry *libs = find_libs(all_loaded_packages());
+    for (int i = 0; i < array_len(libs); i++) {
+        fprintf(f, "%s-l%s", sep, libs[i].name);
+        sep = " ";
+    }
+    fprintf(f, "\n");
+}
+
+FILE *open_output(char *filename) {
+    char *err;
+    FILE *f = open_file_or_error(filename, "w", &err);
+    if (!f) {
+        fprintf(stderr, "Could not open file '%s' for output: %s\n", filename, err);
+        exit(1);
+    }
+    return f;
+}
+
+void declare_types(Scope *root_scope, Type **builtins, Type **used_types) {
+    int *declared_type_ids = NULL;
+    for (int i = 0; i < array_len(builtins); i++) {
+        recursively_declare_types(declared_type_ids, root_scope, builtins[i]);
+    }
+    for (int i = 0; i < array_len(used_types); i++) {
+        recursively_declare_types(declared_type_ids, root_scope, used_types[i]);
+    }
+    array_free(declared_type_ids);
+}
+
+void declare_typeinfo(Scope *root_scope, Type **builtins, Type **used_types, void (*emit)(Scope *, Type *)) {
+    for (int i = 0; i < array_len(builtins); i++) {
+        emit(root_scope, builtins[i]);
+    }
+    int *declared_type_ids = NULL;
+    for (int i = 0; i < array_len(used_types); i++) {
+        char skip = 0;
+        for (int j = 0; j < array_len(declared_type_ids); j++) {
+            if (used_types[i]->id == declared_type_ids[j]) {
+                skip = 1;
+                break;
+            }
+        }
+        if (!skip) {
+            array_push(declared_type_ids, used_types[i]->id);
+            emit(root_scope, used_types[i]);
+        }
+    }
+    array_free(declared_type_ids);
+}
+
+void declare_globals(Package *main_package, Package **packages, void (*emit)(Scope *, Var *)) {
+    for (int i = 0; i < array_len(main_package->globals); i++) {
+        emit(main_package->scope, main_package->globals[i]);
+    }
+    for (int i = 0; i < array_len(packages); i++) {
+        Package *p = packages[i];
+        for (int j = 0; j < array_len(p->globals); j++) {
+            emit(p->scope, p->globals[j]);
+        }
+    }
+}
+
+Var *find_main_var(Ast **fns) {
+    Var *main_var = NULL;
+    for (int i = 0; i < array_len(fns); i++) {
+        Var *v = fns[i]->fn_decl->var;
+        if (!strcmp(v->name, "main")) {
+            main_var = v;
+        }
+    }
+    return main_var;
+}
+
+char *join_path(char *dir, char *name) {
+    int len = strlen(dir) + strlen(name) + 1;
+    char *out = malloc(sizeof(char) * (len + 1));
+    snprintf(out, len + 1, "%s/%s", dir, name);
+    return out;
+}
+
+int same_contents(char *a, char *b) {
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    int same = fa && fb;
+    while (same) {
+        char bufa[4096], bufb[4096];
+        size_t na = fread(bufa, 1, sizeof(bufa), fa);
+        size_t nb = fread(bufb, 1, sizeof(bufb), fb);
+        same = na == nb && !memcmp(bufa, bufb, na);
+        if (na == 0) {
+            break;
+        }
+    }
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+    return same;
+}
+
+// Units are written next to their final path, and only moved into place if
+// they changed, so that unchanged units keep their mtime and whatever was
+// built from them stays up to date.
+FILE *begin_unit(char *path) {
+    char *tmp = malloc(sizeof(char) * (strlen(path) + 5));
+    sprintf(tmp, "%s.tmp", path);
+    FILE *f = open_output(tmp);
+    free(tmp);
+    codegen_set_output(f);
+    return f;
+}
+
+void end_unit(FILE *f, char *path) {
+    codegen_flush();
+    fclose(f);
+    char *tmp = malloc(sizeof(char) * (strlen(path) + 5));
+    sprintf(tmp, "%s.tmp", path);
+    if (same_contents(tmp, path)) {
+        unlink(tmp);
+    } else if (rename(tmp, path)) {
+        fprintf(stderr, "Could not write '%s': %s\n", path, strerror(errno));
+        exit(1);
+    }
+    free(tmp);
+}
+
+// Returns the imported package fn was declared in (polymorphs included), or
+// NULL for the main package.
+Package *fn_package(Ast *fn, Package **packages) {
+    Scope *s = fn->fn_decl->scope;
+    while (s->parent) {
+        s = s->parent;
+    }
+    for (int i = 0; i < array_len(packages); i++) {
+        if (packages[i]->scope == s) {
+            return packages[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns the functions of the main package and of the packages it loaded.
+// A compile server's children also have the rest of the standard library
+// checked (see run_server), whose functions are left out.
+Ast **program_funcs(Package *main_package, Package **packages) {
+    Ast **fns = get_global_funcs();
+    Ast **out = NULL;
+    for (int i = 0; i < array_len(fns); i++) {
+        Scope *s = fns[i]->fn_decl->scope;
+        while (s->parent) {
+            s = s->parent;
+        }
+        if (s == main_package->scope || fn_package(fns[i], packages)) {
+            array_push(out, fns[i]);
+        }
+    }
+    return out;
+}
+
+// Likewise for the used types, which the rest of the standard library adds
+// to as well.
+Type **program_used_types(Package *main_package, Package **packages) {
+    Package **users = NULL;
+    array_push(users, main_package);
+    for (int i = 0; i < array_len(packages); i++) {
+        array_push(users, packages[i]);
+    }
+    Type **types = used_types_of(users);
+    array_free(users);
+    return types;
+}
+
+void emit_profile_comment(Profile *p) {
+    char *flags = profile_flags_string(p);
+    write_bytes("// built with -O %s: %s\n", p->name, flags);
+    free(flags);
+}
+
+// With -split, the program is written to dir as verse.h, which declares
+// everything, main.c, which holds the runtime, the definitions of globals and
+// typeinfo, and the main package, and one pkgN_name.c per imported package
+// with its functions. The list of C files is written to dir/units.
+// Returns the paths of the C files written.
+char **emit_split(char *dir, Package *main_package, Scope *root_scope, Ast *root, Profile *recorded) {
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        fprintf(stderr, "Could not create directory '%s': %s\n", dir, strerror(errno));
+        exit(1);
+    }
+    codegen_set_split(1);
+
+    int decls_length = prelude_decls_length();
+
+    Package **packages = all_loaded_packages();
+    Type **used_types = program_used_types(main_package, packages);
+    Type **builtins = builtin_types();
+    Ast **fns = program_funcs(main_package, packages);
+
+    char *path = join_path(dir, "verse.h");
+    FILE *f = begin_unit(path);
+    if (recorded) {
+        emit_profile_comment(recorded);
+    }
+    write_bytes("#ifndef _VERSE_H\n#define _VERSE_H\n");
+    write_bytes("%.*s\n", decls_length, prelude);
+    timing_begin(PHASE_EMIT_DECLS, "");
+    declare_types(root_scope, builtins, used_types);
+    timing_end();
+    timing_begin(PHASE_EMIT_TYPEINFO, "");
+    declare_typeinfo(root_scope, builtins, used_types, emit_extern_typeinfo_decl);
+    timing_end();
+    timing_begin(PHASE_EMIT_DECLS, "");
+    declare_globals(main_package, packages, emit_extern_var_decl);
+    for (int i = 0; i < array_len(fns); i++) {
+        emit_forward_decl(root_scope, fns[i]->fn_decl);
+    }
+    timing_end();
+    write_bytes("#endif\n");
+    timing_begin(PHASE_WRITE_OUTPUT, "");
+    end_unit(f, path);
+    timing_end();
+
+    char **units = NULL;
+    array_push(units, "main.c");
+    path = join_path(dir, "main.c");
+    f = begin_unit(path);
+    write_bytes("#include \"verse.h\"\n");
+    if (!runtime_lib) {
+        write_bytes("%.*s\n", prelude_length - decls_length, prelude + decls_length);
+    }
+    codegen_begin_literals();
+    timing_begin(PHASE_EMIT_TYPEINFO, "");
+    declare_typeinfo(root_scope, builtins, used_types, emit_typeinfo_decl);
+    timing_end();
+    timing_begin(PHASE_EMIT_DECLS, "");
+    declare_globals(main_package, packages, emit_var_decl);
+    timing_end();
+    timing_begin(PHASE_EMIT_TYPEINFO, "");
+    emit_typeinfo_init_routine(root_scope, builtins, used_types);
+    timing_end();
+    timing_begin(PHASE_EMIT_FNS, main_package->name);
+    for (int i = 0; i < array_len(fns); i++) {
+        if (!fn_package(fns[i], packages)) {
+            emit_func_decl(root_scope, fns[i]);
+        }
+    }
+    emit_init_routine(packages, root_scope, root, find_main_var(fns));
+    emit_entrypoint();
+    timing_end();
+    timing_begin(PHASE_WRITE_OUTPUT, "");
+    end_unit(f, path);
+    timing_end();
+
+    for (int i = 0; i < array_len(packages); i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "pkg%d_%s.c", i, packages[i]->name);
+        array_push(units, strdup(name));
+        path = join_path(dir, name);
+        f = begin_unit(path);
+        write_bytes("#include \"verse.h\"\n\n");
+        codegen_begin_literals();
+        timing_begin(PHASE_EMIT_FNS, packages[i]->name);
+        for (int j = 0; j < array_len(fns); j++) {
+            if (fn_package(fns[j], packages) == packages[i]) {
+                emit_func_decl(root_scope, fns[j]);
+            }
+        }
+        timing_end();
+        timing_begin(PHASE_WRITE_OUTPUT, "");
+        end_unit(f, path);
+        timing_end();
+    }
+
+    path = join_path(dir, "units");
+    f = begin_unit(path);
+    char **c_files = NULL;
+    for (int i = 0; i < array_len(units); i++) {
+        write_bytes("%s\n", units[i]);
+        array_push(c_files, join_path(dir, units[i]));
+    }
+    end_unit(f, path);
+    return c_files;
+}
+
+char *libs_line() {
+    char *line = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&line, &len);
+    print_libs(f);
+    fclose(f);
+    return line;
+}
+
+// Builds exe from the generated C, the runtime's assembly files and libs
+// (the -libs output).
+int build(char *exe, Profile *profile, char **c_files, char *header, char *libs, int jobs, int verbose) {
+    char *root = root_from_binary();
+    char *pattern = malloc(sizeof(char) * (strlen(root) + 16));
+    sprintf(pattern, "%ssrc/*/*.S", root);
+    glob_t g;
+    char **asm_files = NULL;
+    if (glob(pattern, 0, NULL, &g) == 0) {
+        for (size_t i = 0; i < g.gl_pathc; i++) {
+            array_push(asm_files, g.gl_pathv[i]);
+        }
+    }
+    char **lib_flags = NULL;
+    for (char *lib = strtok(libs, " \n"); lib; lib = strtok(NULL, " \n")) {
+        array_push(lib_flags, lib);
+    }
+    return build_executable(profile, c_files, header, asm_files, lib_flags, exe, jobs, verbose);
+}
+
+// Set in a compile server's children: the main package and the builtins
+// were set up, and the standard library parsed and checked, before forking.
+static int preloaded = 0;
+
+int compile_program(int argc, char **argv);
+
+int run_server(char *socket_path, int jobs) {
+    init_main_package(NULL);
+    init_builtin_types();
+    init_builtins();
+    preload_packages(jobs);
+    check_preloaded_packages(get_main_package()->scope);
+    preloaded = 1;
+    serve(socket_path, compile_program);
+    fprintf(stderr, "Could not serve on '%s': %s\n", socket_path, strerror(errno));
+    return 1;
+}
+
+int send_to_server(char *socket_path, int argc, char **argv) {
+    // forward everything but the -connect flag itself
+    char **forward = NULL;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "-connect") && i + 1 < argc) {
+            i++;
+            continue;
+        }
+        array_push(forward, argv[i]);
+    }
+    int code = serve_request(socket_path, array_len(forward), forward);
+    if (code < 0) {
+        fprintf(stderr, "Could not reach compile server on '%s': %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+    return code;
+}
+
 int main(int argc, char **argv) {
+    return compile_program(argc, argv);
+}
+
+int compile_program(int argc, char **argv) {
     struct flag_set flags = {
         .help_flag   = {"h", "help", "print usage and exit", 0, 0, ""},
         .output_flag = {"o", "output", "specify output file, defaults to [input-base].c", 0, 1, ""},
         .libs_flag   = {NULL, "libs", "output required gcc linker flags from #lib directives", 0, 0, ""},
+        .stats_flag  = {NULL, "stats", "print compiler statistics to stderr", 0, 0, ""},
+        .jobs_flag   = {"j", "jobs", "parse imported packages, and with -build run the C compiler, on this many threads", 0, 1, ""},
+        .emit_libs_flag = {NULL, "emit-libs", "also write the -libs linker flags to this file", 0, 1, ""},
+        .verbose_flag   = {"v", "verbose", "print the C compiler commands -build runs", 0, 0, ""},
+        .split_flag     = {NULL, "split", "write a header and one C file per package into this directory, instead of -o", 0, 1, ""},
+        .serve_flag     = {NULL, "serve", "run a compile server on this unix socket, with the standard library loaded", 0, 1, ""},
+        .connect_flag   = {NULL, "connect", "send this compile to the server on this unix socket", 0, 1, ""},
+        .profile_flag   = {"O", "profile", "C compiler flags for -build: debug (default), release or native; recorded in the output", 0, 1, ""},
+        .build_flag     = {"b", "build", "also build the output into this executable, with $CC (default gcc)", 0, 1, ""},
+        .runtime_lib_flag = {NULL, "runtime-lib", "declare the runtime instead of including it, and link bin/libverse_rt.a", 0, 0, ""},
+        .time_report_flag = {NULL, "time-report", "print time and allocations per compiler phase and package to stderr", 0, 0, ""},
+        .trace_flag     = {NULL, "trace", "write a Chrome trace-event file of package loads, parses, checks and codegen", 0, 1, ""},
     };
 
     char **args = parse_flags_get_args(&flags, argc, argv);
 
+    int jobs = 1;
+    if (flags.jobs_flag.set) {
+        jobs = atoi(flags.jobs_flag.value);
+        if (jobs < 1) {
+            errlog("Expected a positive number of jobs, got '%s'", flags.jobs_flag.value);
+            exit(1);
+        }
+    }
+
+    if (flags.serve_flag.set || flags.connect_flag.set) {
+        if (preloaded) {
+            errlog("A compile server can't run -serve or -connect");
+            return 1;
+        }
+        if (flags.serve_flag.set) {
+            return run_server(flags.serve_flag.value, jobs);
+        }
+        return send_to_server(flags.connect_flag.value, argc, argv);
+    }
+    // checked packages can't be loaded again, so if one was edited since the
+    // server started, compile in a fresh process instead
+    if (preloaded && preloaded_packages_changed()) {
+        execv("/proc/self/exe", argv);
+        errlog("Could not restart the compiler: %s", strerror(errno));
+        return 1;
+    }
+
     if (array_len(args) != 1) {
         print_usage(&flags, argv[0]);
         exit(1);
     }
 
-    char *base_name = "main";
-    if (!strcmp(args[0], "-")) {
-        push_file_source("<stdin>", stdin);
-    } else {
-        push_file_source(args[0], open_file_or_quit(args[0], "r"));
-        base_name = strip_vs_ext(package_name(args[0]));
+    Profile *profile = find_profile(flags.profile_flag.set ? flags.profile_flag.value : "debug");
+    if (!profile) {
+        errlog("Unknown profile '%s', expected debug, release or native", flags.profile_flag.value);
+        exit(1);
+    }
+    // only an explicit -O is recorded, so the output doesn't change otherwise
+    Profile *recorded = flags.profile_flag.set ? profile : NULL;
+    runtime_lib = flags.runtime_lib_flag.set;
+    if (flags.time_report_flag.set) {
+        timing_enable();
+    }
+    if (flags.trace_flag.set && !trace_open(flags.trace_flag.value)) {
+        errlog("Could not open trace file '%s': %s", flags.trace_flag.value, strerror(errno));
+        exit(1);
     }
-    
-    Package *main_package = init_main_package(current_file_name());
-    Scope *root_scope = main_package->scope;
-    init_builtin_types();
-    init_builtins();
-
-    struct timeval start_time;
-    struct timeval parse_done_time;
-
-    gettimeofday(&start_time, NULL);
-    Ast *root = parse_block(0);
-    gettimeofday(&parse_done_time, NULL);
-
-    /*fprintf(stderr, "parse: %ld secs, %ld microseconds\n",*/
-            /*parse_done_time.tv_sec - start_time.tv_sec,*/
-            /*parse_done_time.tv_usec - start_time.tv_usec);*/
-
-    root = check_semantics(root_scope, root);
 
-    if (flags.libs_flag.set) {
-        LibEntry *libs = find_libs(all_loaded_packages());
-        for (int i = 0; i < array_len(libs); i++) {
-            if (i > 0) {
-                printf(" ");
-            }
-            printf("-l%s", libs[i].name);
-        }
-        printf("\n");
-        exit(0);
+    int from_stdin = !strcmp(args[0], "-");
+    char *base_name = "main";
+    if (!from_stdin) {
+        base_name = strip_vs_ext(package_name(args[0]));
     }
 
-    // determine output file name, and open it
-    FILE *output_file = stdout;
+    // determine output file name
     char *output_filename = NULL;
     if (flags.output_flag.set) {
         if (!strcmp(flags.output_flag.value, "-")) {
@@ -168,87 +589,133 @@ int main(int argc, char **argv) {
         output_filename = malloc(sizeof(char) * (strlen(base_name) + 3));
         sprintf(output_filename, "%s.c", base_name);
     }
-    if (output_filename) {
-        char *err;
-        FILE *f = open_file_or_error(output_filename, "w", &err);
-        if (!f) {
-            fprintf(stderr, "Could not open file '%s' for output: %s\n", output_filename, err);
-            exit(1);
-        }
-        output_file = f;
+    if (flags.build_flag.set && !output_filename && !flags.split_flag.set) {
+        errlog("-build needs the C output in a file, not on stdout");
+        exit(1);
     }
-    codegen_set_output(output_file);
+    char **c_files = NULL;
+    array_push(c_files, output_filename);
 
-    Var *main_var = NULL;
+    if (from_stdin) {
+        push_file_source("<stdin>", stdin);
+    } else {
+        push_file_source(args[0], open_file_or_quit(args[0], "r"));
+    }
+    
+    Package *main_package = NULL;
+    if (preloaded) {
+        main_package = get_main_package();
+        main_package->path = current_file_name();
+    } else {
+        main_package = init_main_package(current_file_name());
+        init_builtin_types();
+        init_builtins();
+    }
+    Scope *root_scope = main_package->scope;
 
-    write_bytes("%.*s\n", prelude_length, prelude);
+    timing_begin(PHASE_PARSE, main_package->name);
+    trace_begin("parse", current_file_name(), NULL);
+    Ast *root = parse_block(0);
+    trace_end();
+    timing_end();
 
-    Type **used_types = all_used_types();
-    Type **builtins = builtin_types();
+    if (jobs > 1) {
+        start_package_loader(jobs, root);
+    }
 
-    int *declared_type_ids = NULL;
-    // declare structs
-    for (int i = 0; i < array_len(builtins); i++) {
-        recursively_declare_types(declared_type_ids, root_scope, builtins[i]);
+    timing_begin(PHASE_CHECK, main_package->name);
+    root = check_semantics(root_scope, root);
+    timing_end();
+
+    if (flags.stats_flag.set) {
+        fprintf(stderr, "polymorph cache: %d hits, %d misses\n",
+                polymorph_cache_hits(), polymorph_cache_misses());
     }
-    for (int i = 0; i < array_len(used_types); i++) {
-        recursively_declare_types(declared_type_ids, root_scope, used_types[i]);
+
+    if (flags.libs_flag.set) {
+        print_libs(stdout);
+        timing_report(stderr);
+        exit(0);
     }
-    // declare other types
-    for (int i = 0; i < array_len(builtins); i++) {
-        emit_typeinfo_decl(root_scope, builtins[i]);
+    if (flags.emit_libs_flag.set) {
+        FILE *f = open_output(flags.emit_libs_flag.value);
+        print_libs(f);
+        fclose(f);
     }
-    array_free(declared_type_ids);
-    declared_type_ids = NULL;
-    for (int i = 0; i < array_len(used_types); i++) {
-        char skip = 0;
-        for (int j = 0; j < array_len(declared_type_ids); j++) {
-            if (used_types[i]->id == declared_type_ids[j]) {
-                skip = 1;
-                break;
-            }
-        }
-        if (!skip) {
-            array_push(declared_type_ids, used_types[i]->id);
-            emit_typeinfo_decl(root_scope, used_types[i]);
+
+    if (flags.split_flag.set) {
+        char *dir = flags.split_flag.value;
+        c_files = emit_split(dir, main_package, root_scope, root, recorded);
+        timing_report(stderr);
+        if (!flags.build_flag.set) {
+            return 0;
         }
+        return build(flags.build_flag.value, profile, c_files, join_path(dir, "verse.h"), libs_line(),
+                jobs, flags.verbose_flag.set);
     }
-    array_free(declared_type_ids);
-    declared_type_ids = NULL;
 
-    // declare globals
-    for (int i = 0; i < array_len(main_package->globals); i++) {
-        emit_var_decl(root_scope, main_package->globals[i]);
+    FILE *output_file = stdout;
+    if (output_filename) {
+        output_file = open_output(output_filename);
     }
-    Package **packages = all_loaded_packages();
-    for (int i = 0; i < array_len(packages); i++) {
-        Package *p = packages[i];
-        for (int j = 0; j < array_len(p->globals); j++) {
-            emit_var_decl(p->scope, p->globals[j]);
-        }    
+    codegen_set_output(output_file);
+
+    timing_begin(PHASE_WRITE_OUTPUT, "");
+    if (recorded) {
+        emit_profile_comment(recorded);
     }
+    write_bytes("%.*s\n", runtime_lib ? prelude_decls_length() : prelude_length, prelude);
+    codegen_begin_literals();
+    timing_end();
+
+    Package **packages = all_loaded_packages();
+    Type **used_types = program_used_types(main_package, packages);
+    Type **builtins = builtin_types();
+
+    timing_begin(PHASE_EMIT_DECLS, "");
+    declare_types(root_scope, builtins, used_types);
+    timing_end();
+    timing_begin(PHASE_EMIT_TYPEINFO, "");
+    declare_typeinfo(root_scope, builtins, used_types, emit_typeinfo_decl);
+    timing_end();
+    timing_begin(PHASE_EMIT_DECLS, "");
+    declare_globals(main_package, packages, emit_var_decl);
+    timing_end();
 
     // init types
+    timing_begin(PHASE_EMIT_TYPEINFO, "");
     emit_typeinfo_init_routine(root_scope, builtins, used_types);
+    timing_end();
 
-    Ast **fns = get_global_funcs();
+    Ast **fns = program_funcs(main_package, packages);
+    timing_begin(PHASE_EMIT_DECLS, "");
     for (int i = 0; i < array_len(fns); i++) {
-        Var *v = fns[i]->fn_decl->var;
-        if (!strcmp(v->name, "main")) {
-            main_var = v;
-        }
         emit_forward_decl(root_scope, fns[i]->fn_decl);
     }
+    timing_end();
     for (int i = 0; i < array_len(fns); i++) {
+        Package *p = fn_package(fns[i], packages);
+        timing_begin(PHASE_EMIT_FNS, (p ? p : main_package)->name);
         emit_func_decl(root_scope, fns[i]);
+        timing_end();
     }
 
-    emit_init_routine(packages, root_scope, root, main_var);
+    timing_begin(PHASE_EMIT_FNS, main_package->name);
+    emit_init_routine(packages, root_scope, root, find_main_var(fns));
     emit_entrypoint();
+    timing_end();
 
-    if (!output_file) {
-        return 0;
+    timing_begin(PHASE_WRITE_OUTPUT, "");
+    codegen_flush();
+    if (output_file != stdout) {
+        fclose(output_file);
     }
+    timing_end();
+    timing_report(stderr);
 
+    if (flags.build_flag.set) {
+        return build(flags.build_flag.value, profile, c_files, NULL, libs_line(),
+                jobs, flags.verbose_flag.set);
+    }
     return 0;
 }
@@ -9,6 +9,12 @@ x:int = 2;
 x1:int = 2;
 x2:string = "hi";
 
+extern fn sbrk(int) -> ptr;
+
+fn heap_name(n: int) -> string {
+    return "a name long enough to live on the heap: " + itoa(n);
+}
+
 fn to_be_passed() -> bool {
     return false;
 }
@@ -111,6 +117,63 @@ fn main() -> int {
     s1 = s[:];
     assert(s == s1);
 
+    // slices that are only read borrow s instead of copying it
+    assert(s[5:5] == "kinda");
+    assert(s[5:5] != s[0:5]);
+    assert(s[5:5][1] == "i");
+    assert(s[15:100].length == 10);
+    assert(s[15:][4:3] == "str");
+    s2 := s[0:4] + " " + s[19:];
+    assert(s2 == "some string");
+
+    // up to 15 bytes are kept inline, longer strings on the heap
+    short := "fifteen bytes!!";
+    long := short + "+";
+    assert(long.length == 16);
+    assert(long[0:15] == short);
+    assert(long[15] == "+");
+    assert((short + short)[15:15] == short);
+    assert(itoa(-1234567890123456789) == "-1234567890123456789");
+
+    // a + chain is built in one go, StringBuilder grows in place
+    n := 3;
+    assert(s[0:4] + " " + itoa(n) + " " + s[19:] == "some 3 string");
+    b: StringBuilder;
+    i := 0;
+    while i < 100 {
+        sb_append(&b, itoa(i % 10));
+        i += 1;
+    }
+    sb_append_byte(&b, "!");
+    assert(b.buf.length == 101);
+    built := sb_string(&b);
+    assert(built[0:12] == "012345678901");
+    assert(built[100] == "!");
+    assert(b.buf.length == 0);
+
+    // owned parts of a + chain are freed once it's built, so building the
+    // same chain over and over doesn't grow the heap
+    built = "pre " + heap_name(n) + " mid " + heap_name(n);
+    assert(built.length == 91);
+    assert(built[0:4] + built[45:6] == "pre  mid a");
+    heap_start := sbrk(0) as int;
+    i = 0;
+    while i < 100000 {
+        t := "pre " + heap_name(i) + " mid " + heap_name(n);
+        i += 1;
+    }
+    assert((sbrk(0) as int) - heap_start < 1000000);
+
+    // literals are static data, shared by copies rather than copied
+    lit := "a literal too long to be kept inline";
+    lit2 := lit;
+    assert(lit2 == lit);
+    assert(lit[2:7] == "literal");
+    b.buf = lit;
+    sb_append(&b, "!");
+    assert(b.buf.length == lit.length + 1);
+    assert(lit[lit.length - 6:] == "inline");
+
     assert("\r\n"[0] == 13);
 
     assert((10 as u8) == "\n");
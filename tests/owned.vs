@@ -67,8 +67,41 @@ fn test_return_owned_from_function() -> 'Dude {
     return test_return_owned_variable();
 }
 
+fn pass_on(s: string) -> string {
+    t := s;
+    return t;
+}
+
+fn longest(words: []string) -> string {
+    best := "";
+    for w in words {
+        if w.length > best.length {
+            best = w;
+        }
+    }
+    return best;
+}
+
+fn test_moves() {
+    s := "moved";
+    t := pass_on(s);
+    assert(t == "moved");
+    u := t;
+    assert(u == "moved");
+
+    d := Dude::{a = "x"};
+    e := d;
+    e.a = "y";
+    assert(e.a == "y");
+
+    words := []string::{"a", "abc", "ab"};
+    assert(longest(words) == "abc");
+    assert(words[1] == "abc");
+}
+
 fn main() -> int {
     test_return_owned_ref();
+    test_moves();
     test_new_struct();
 
     arr: '[]string;
@@ -0,0 +1,102 @@
+// Calls one generic function with many distinct argument type combinations,
+// each of them more than once, so instantiations have to be found again.
+// expect-stats: polymorph cache: 26 hits, 31 misses
+
+type Box: struct(T){
+    inner: T;
+};
+
+fn second(a: $A, b: $B) -> B {
+    return b;
+}
+
+fn count(a: $A, b: $B, n: int) -> int {
+    return n + 1;
+}
+
+// x is only known here as the type parameter T, and the other args are
+// built again, so each call below mixes an arg matched through T with args
+// matched by their structure
+fn count_through(x: $T, n: int) -> int {
+    n = count(x, []string::{"a"}, n);
+    n = count(2, x, n);
+    n = count(x, Box(string)::{"a"}, n);
+    return n;
+}
+
+fn count_all(n: int) -> int {
+    n = count(1, 2, n);
+    n = count(1, "two", n);
+    n = count("one", 2, n);
+    n = count("one", "two", n);
+    n = count(1.5, 2, n);
+    n = count(1, 2.5, n);
+    n = count(true, 2, n);
+    n = count(1, false, n);
+    n = count(&n, 2, n);
+    n = count(2, &n, n);
+    n = count([]int::{1, 2}, 2, n);
+    n = count(2, []string::{"a"}, n);
+    n = count(Box(int)::{1}, 2, n);
+    n = count(2, Box(string)::{"a"}, n);
+    n = count(Box(int)::{1}, Box(string)::{"a"}, n);
+    n = count(Box(Box(int))::{Box(int)::{1}}, 2, n);
+    n = count(2 as u8, 2 as s64, n);
+    n = count(2 as s64, 2 as u8, n);
+    return n;
+}
+
+fn main() -> int {
+    n := 0;
+    for i in []int::{0, 1, 2} {
+        n = count_all(n);
+    }
+    assert(n == 54);
+
+    // same combinations again, from other call sites
+    m := 0;
+    for i in []int::{0, 1} {
+        m = count_all(m);
+    }
+    m = count(1, 2, m);
+    m = count(1, "two", m);
+    m = count("one", 2, m);
+    m = count("one", "two", m);
+    m = count(1.5, 2, m);
+    m = count(1, 2.5, m);
+    m = count(true, 2, m);
+    m = count(1, false, m);
+    m = count(&n, 2, m);
+    m = count(2, &n, m);
+    m = count([]int::{1, 2}, 2, m);
+    m = count(2, []string::{"a"}, m);
+    m = count(Box(int)::{1}, 2, m);
+    m = count(2, Box(string)::{"a"}, m);
+    m = count(Box(int)::{1}, Box(string)::{"a"}, m);
+    m = count(Box(Box(int))::{Box(int)::{1}}, 2, m);
+    m = count(2 as u8, 2 as s64, m);
+    m = count(2 as s64, 2 as u8, m);
+    assert(m == 54);
+
+    k := 0;
+    k = count([]int::{1, 2}, []string::{"a"}, k);
+    k = count(Box(int)::{1}, []string::{"a"}, k);
+    k = count_through([]int::{1, 2}, k);
+    k = count_through(Box(int)::{1}, k);
+    k = count_through([]int::{3}, k);
+    assert(k == 11);
+
+    assert(second(1, 2) == 2);
+    assert(second("a", 2) == 2);
+    assert(second(1, "b") == "b");
+    assert(second(1.5, "b") == "b");
+    assert(second(1.5, 2) == 2);
+    assert(second("a", 2) == 2);
+    assert(second(1, "b") == "b");
+    assert(second(true, Box(int)::{3}).inner == 3);
+    assert(second(false, Box(int)::{4}).inner == 4);
+    assert(second(1, 2) == 2);
+
+    println("ok");
+    return 0;
+}